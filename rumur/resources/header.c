@@ -44,7 +44,10 @@ enum { STATE_SIZE_BYTES = BITS_TO_BYTES(STATE_SIZE_BITS) };
 
 /* the size of auxliary members of the state struct */
 enum { BOUND_BITS = BITS_FOR(BOUND) };
-#if COUNTEREXAMPLE_TRACE != CEX_OFF || LIVENESS_COUNT > 0
+/* whether states record a pointer to their predecessor */
+#define PREVIOUS_POINTERS \
+  ((COUNTEREXAMPLE_TRACE != CEX_OFF && !TRACE_REPLAY) || LIVENESS_COUNT > 0)
+#if PREVIOUS_POINTERS
   #if POINTER_BITS != 0
     enum { PREVIOUS_BITS = POINTER_BITS };
   #elif defined(__linux__) && defined(__x86_64__) && !defined(__ILP32__)
@@ -109,7 +112,8 @@ static _Thread_local size_t thread_id;
 static pthread_t threads[THREADS - 1];
 
 /* What we are currently doing. Either "warming up" (running single threaded
- * building up queue occupancy) or "free running" (running multithreaded).
+ * building up queue occupancy) or "free running" (running multithreaded). With
+ * EAGER_STARTUP, we skip warming up.
  */
 static enum { WARMUP, RUN } phase = WARMUP;
 
@@ -129,6 +133,79 @@ static unsigned long error_count;
 static _Thread_local uintmax_t rules_fired_local;
 static uintmax_t rules_fired[THREADS];
 
+#if RULE_PROFILE_RULES > 0
+/* Per-rule statistics written out for --rule-profile-generate. As with
+ * rules_fired, these are counted thread-locally and published as each thread
+ * exits.
+ */
+struct rule_profile {
+  uint64_t evaluated;  /* guard evaluations */
+  uint64_t enabled;    /* guard evaluations that returned true */
+  uint64_t successors; /* successor states produced */
+  uint64_t fresh;      /* successor states not previously seen */
+};
+static _Thread_local struct rule_profile rule_profile_local[RULE_PROFILE_RULES];
+static struct rule_profile rule_profile[THREADS][RULE_PROFILE_RULES];
+
+/* Destination of the profile. This is opened before entering the sandbox. */
+static FILE *rule_profile_file;
+#endif
+
+/* Whether checking threads keep counters that other threads can read while
+ * checking is underway.
+ */
+#define LIVE_COUNTERS (TELEMETRY_FD >= 0 || METRICS_SOCKET)
+
+#if LIVE_COUNTERS
+/* Counters sampled by the telemetry and metrics threads. Each checking thread
+ * writes only its own entry, using relaxed stores, so keeping them up to date
+ * costs no more than plain writes. Entries are cache line aligned to avoid
+ * false sharing.
+ */
+struct telemetry_counters {
+  uint64_t states;      /* new states found by this thread */
+  uint64_t rules_fired; /* rules fired by this thread */
+  uint64_t arena_bytes; /* bytes in this thread's state allocator pools */
+} __attribute__((aligned(64)));
+static struct telemetry_counters telemetry[THREADS];
+
+/* Capacity of the seen set in slots and the number of times it has expanded.
+ * These are only written under the set expansion lock.
+ */
+static size_t telemetry_set_slots;
+static uint64_t telemetry_set_expansions;
+
+/* Bump a counter that only the calling thread writes. */
+static void telemetry_add(uint64_t *NONNULL counter, uint64_t n) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+    __ATOMIC_RELAXED);
+}
+#endif
+
+#if METRICS_SOCKET
+/* Listening socket for --metrics-socket. This is opened before entering the
+ * sandbox, which permits accepting connections on it alone.
+ */
+static int metrics_fd = -1;
+#endif
+
+#if RULE_STATISTICS > 0
+/* Per-rule-instance performance counters for --rule-statistics, indexed by
+ * rule_taken - 1. Each thread counts into its own array without atomics and
+ * publishes it as it exits.
+ */
+struct rule_statistics {
+  uint64_t evaluated;  /* times the rule was tried */
+  uint64_t fired;      /* times its guard held and its body completed */
+  uint64_t fresh;      /* successor states not seen before */
+  uint64_t duplicates; /* successor states already seen */
+  uint64_t guards;     /* times its guard was evaluated, not taken from cache */
+  uint64_t time;       /* time spent trying the rule */
+};
+static _Thread_local struct rule_statistics *rule_statistics_local;
+static struct rule_statistics *rule_statistics[THREADS];
+#endif
+
 /* Checkpoint to restore to after reporting an error. This is only used if we
  * are tolerating more than one error before exiting.
  */
@@ -143,11 +220,43 @@ _Static_assert(MAX_ERRORS > 0, "illegal MAX_ERRORS value");
  *      hit MAX_ERRORS. In this case we want to longjmp back to resume checking.
  *   2. We failed an assume statement. In this case we want to mark the current
  *      state as invalid and resume checking with the next state.
- * In either scenario the actual longjmp performed is the same, but by knowing
- * statically whether either can occur we can avoid calling setjmp if both are
- * impossible.
+ *   3. We are reconstructing a counterexample trace (--trace-replay) and a
+ *      rule we fire again errors. In this case we want to discard the state
+ *      being generated.
+ * In each scenario the actual longjmp performed is the same, but by knowing
+ * statically whether any can occur we can avoid calling setjmp if all are
+ * impossible. Even when one can occur, the generated rules, guards and property
+ * checks do not set checkpoints themselves. Exploration sets a single
+ * checkpoint and resumes after whichever rule was interrupted (see
+ * `struct expansion`), while colder paths wrap each call in CHECKPOINTED.
  */
-enum { JMP_BUF_NEEDED = MAX_ERRORS > 1 || ASSUME_STATEMENTS_COUNT > 0 };
+enum { JMP_BUF_NEEDED = MAX_ERRORS > 1 || ASSUME_STATEMENTS_COUNT > 0
+  || (TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF) };
+
+/* Evaluate `call`, a call into generated code, yielding `failed` instead if it
+ * unwinds to the checkpoint. The caller's own checkpoint is restored
+ * afterwards.
+ */
+#define CHECKPOINTED(call, failed) \
+  __extension__ ({ \
+    __typeof__(call) volatile checkpointed_ = (failed); \
+    if (JMP_BUF_NEEDED) { \
+      sigjmp_buf checkpointed_saved_; \
+      memcpy(&checkpointed_saved_, &checkpoint, sizeof(checkpointed_saved_)); \
+      if (sigsetjmp(checkpoint, 0) == 0) { \
+        checkpointed_ = (call); \
+      } \
+      memcpy(&checkpoint, &checkpointed_saved_, sizeof(checkpointed_saved_)); \
+    } else { \
+      checkpointed_ = (call); \
+    } \
+    checkpointed_; \
+  })
+
+#if TRACE_REPLAY
+/* Whether this thread is reconstructing a counterexample trace. */
+static _Thread_local bool replaying;
+#endif
 
 /*******************************************************************************
  * Sandbox support.                                                            *
@@ -200,8 +309,22 @@ static void sandbox(void) {
       exit(EXIT_FAILURE);
     }
 
-    /* A BPF program that traps on any syscall we want to disallow. */
-    static struct sock_filter filter[] = {
+    /* Whether we will start threads other than the initial one. */
+    enum { MULTITHREADED = THREADS > 1 || TELEMETRY_FD >= 0 || METRICS_SOCKET };
+
+    /* Offset of the low word of a syscall's first argument, for filtering on a
+     * file descriptor.
+     */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    enum { ARG0_LOW = offsetof(struct seccomp_data, args[0]) + 4 };
+#else
+    enum { ARG0_LOW = offsetof(struct seccomp_data, args[0]) };
+#endif
+
+    /* A BPF program that traps on any syscall we want to disallow. It is built
+     * at runtime, so it can refer to descriptors we have opened.
+     */
+    struct sock_filter filter[] = {
 
       /* Load syscall number. */
       BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr)),
@@ -247,44 +370,48 @@ static void sandbox(void) {
       /* If we're running multithreaded, enable syscalls used by pthreads. */
 #ifdef __NR_clone
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_clone, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_close
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_close, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_exit
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_exit, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_futex
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_futex, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_get_robust_list
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_get_robust_list, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_madvise
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_madvise, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_mprotect
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_mprotect, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_open
       // XXX: it would be nice to avoid open() but pthreads seems to open libgcc.
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_open, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_read
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_read, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 #ifdef __NR_set_robust_list
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_set_robust_list, 0, 1),
-      BPF_STMT(BPF_RET|BPF_K, THREADS > 1 ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
+#endif
+#ifdef __NR_sched_yield
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_sched_yield, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, MULTITHREADED ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRAP),
 #endif
 
       /* on platforms without vDSO support, time() makes an actual syscall, so
@@ -298,6 +425,51 @@ static void sandbox(void) {
       BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_time, 0, 1),
       BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
 #endif
+#if (RULE_STATISTICS > 0 || TELEMETRY_FD >= 0) && defined(__NR_clock_gettime)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_clock_gettime, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+#endif
+
+      /* The metrics thread accepts connections on the socket opened before we
+       * entered the sandbox, and only that socket. It waits briefly for
+       * clients' requests and replies with write().
+       */
+#if METRICS_SOCKET && defined(__NR_accept)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_accept, 0, 4),
+      BPF_STMT(BPF_LD|BPF_W|BPF_ABS, ARG0_LOW),
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, (uint32_t)metrics_fd, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRAP),
+#endif
+#if METRICS_SOCKET && defined(__NR_accept4)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_accept4, 0, 4),
+      BPF_STMT(BPF_LD|BPF_W|BPF_ABS, ARG0_LOW),
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, (uint32_t)metrics_fd, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRAP),
+#endif
+#if METRICS_SOCKET && defined(__NR_poll)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_poll, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+#endif
+#if METRICS_SOCKET && defined(__NR_ppoll)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_ppoll, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+#endif
+#if METRICS_SOCKET && defined(__NR_getrusage)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_getrusage, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+#endif
+
+      /* the telemetry thread sleeps between samples */
+#if TELEMETRY_FD >= 0 && defined(__NR_nanosleep)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_nanosleep, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+#endif
+#if TELEMETRY_FD >= 0 && defined(__NR_clock_nanosleep)
+      BPF_JUMP(BPF_JMP|BPF_JEQ|BPF_K, __NR_clock_nanosleep, 0, 1),
+      BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+#endif
 
       /* Deny everything else. On a disallowed syscall, we trap instead of
        * killing to allow the user to debug the failure. If you are debugging
@@ -308,7 +480,7 @@ static void sandbox(void) {
       BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_TRAP),
     };
 
-    static const struct sock_fprog filter_program = {
+    const struct sock_fprog filter_program = {
       .len = sizeof(filter) / sizeof(filter[0]),
       .filter = filter,
     };
@@ -327,7 +499,8 @@ static void sandbox(void) {
 
 #ifdef __OpenBSD__
   {
-    if (__builtin_expect(pledge("stdio", "") != 0, 0)) {
+    if (__builtin_expect(pledge(METRICS_SOCKET ? "stdio unix" : "stdio", "")
+        != 0, 0)) {
       perror("pledge");
       exit(EXIT_FAILURE);
     }
@@ -461,7 +634,8 @@ static __attribute__((const)) bool value_is_signed(void) {
  * More information on this at https://github.com/aappleby/smhasher/           *
  ******************************************************************************/
 
-static uint64_t MurmurHash64A(const void *NONNULL key, size_t len) {
+static __attribute__((unused)) uint64_t MurmurHash64A(const void *NONNULL key,
+                                                      size_t len) {
 
   static const uint64_t seed = 0;
 
@@ -531,22 +705,116 @@ static void *xcalloc(size_t count, size_t size) {
   return p;
 }
 
-static void put(const char *NONNULL s) {
-  for (; *s != '\0'; ++s) {
-    putchar_unlocked(*s);
+static __attribute__((unused)) void *xrealloc(void *p, size_t size) {
+  void *q = realloc(p, size);
+  if (__builtin_expect(q == NULL, 0)) {
+    oom();
+  }
+  return q;
+}
+
+/*******************************************************************************
+ * Output                                                                      *
+ *                                                                             *
+ * Output to stdout is accumulated in a per-thread buffer. Related output,     *
+ * like an error message and its counterexample trace, is bracketed by        *
+ * output_begin() and output_end() and written out in a single step when the   *
+ * outermost such bracket closes. Threads thus never wait on each other while  *
+ * formatting output, only for the duration of a write of a whole record.      *
+ * Outside of these brackets, output is flushed at the end of each line.       *
+ ******************************************************************************/
+
+struct output_buffer {
+  char *data;
+  size_t size;
+  size_t capacity;
+  unsigned depth; /* nesting of output_begin() calls */
+};
+
+static _Thread_local struct output_buffer output;
+
+/* serialises writes of records from different threads */
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void output_flush(void) {
+
+  if (output.size == 0) {
+    return;
+  }
+
+  int r = pthread_mutex_lock(&output_lock);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(r));
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t offset = 0; offset < output.size; ) {
+    ssize_t written = write(STDOUT_FILENO, output.data + offset,
+      output.size - offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      /* nowhere to report a failure to write output, so discard it */
+      break;
+    }
+    offset += (size_t)written;
+  }
+  output.size = 0;
+
+  r = pthread_mutex_unlock(&output_lock);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(r));
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* start a record of output that should be written without interruption */
+static void output_begin(void) {
+  output.depth++;
+}
+
+static void output_end(void) {
+  ASSERT(output.depth > 0 && "unbalanced output_end()");
+  output.depth--;
+  if (output.depth == 0) {
+    output_flush();
+  }
+}
+
+static void output_append(const char *NONNULL s, size_t length) {
+
+  if (output.capacity - output.size < length) {
+    size_t capacity = output.capacity == 0 ? 4096 : output.capacity;
+    while (capacity - output.size < length) {
+      capacity *= 2;
+    }
+    output.data = xrealloc(output.data, capacity);
+    output.capacity = capacity;
   }
+
+  memcpy(output.data + output.size, s, length);
+  output.size += length;
+
+  if (output.depth == 0 && length > 0 && s[length - 1] == '\n') {
+    output_flush();
+  }
+}
+
+static void put(const char *NONNULL s) {
+  output_append(s, strlen(s));
 }
 
 static void put_int(intmax_t u) {
   char buffer[128] = { 0 };
-  snprintf(buffer, sizeof(buffer), "%" PRIdMAX, u);
-  put(buffer);
+  int length = snprintf(buffer, sizeof(buffer), "%" PRIdMAX, u);
+  output_append(buffer, (size_t)length);
 }
 
 static void put_uint(uintmax_t u) {
   char buffer[128] = { 0 };
-  snprintf(buffer, sizeof(buffer), "%" PRIuMAX, u);
-  put(buffer);
+  int length = snprintf(buffer, sizeof(buffer), "%" PRIuMAX, u);
+  output_append(buffer, (size_t)length);
 }
 
 static __attribute__((unused)) void put_val(value_t v) {
@@ -558,13 +826,17 @@ static __attribute__((unused)) void put_val(value_t v) {
 }
 
 static void xml_printf(const char *NONNULL s) {
-  while (*s != '\0') {
+  for (;;) {
+    /* output any run of characters that need no escaping in one go */
+    size_t span = strcspn(s, "\"<>&");
+    output_append(s, span);
+    s += span;
     switch (*s) {
       case '"': put("&quot;"); break;
       case '<': put("&lt;");   break;
       case '>': put("&gt;");   break;
       case '&': put("&amp;");  break;
-      default:  putchar_unlocked(*s); break;
+      default:  return; /* end of string */
     }
     s++;
   }
@@ -636,6 +908,20 @@ struct state {
      LIVENESS_COUNT / sizeof(uintptr_t) % CHAR_BIT == 0 ? 0 : 1)];
 #endif
 
+#if INCREMENTAL_HASH
+  /* Zobrist-style hash of `data`, maintained as the state is written */
+  uint64_t hash;
+#endif
+
+#if GUARD_CACHE_BITS > 0
+  /* Cached rule guard results, one bit per rule instance. A set bit in
+   * `guards_known` means the corresponding bit in `guards_enabled` holds the
+   * result of evaluating that guard against this state.
+   */
+  uint8_t guards_known[BITS_TO_BYTES(GUARD_CACHE_BITS)];
+  uint8_t guards_enabled[BITS_TO_BYTES(GUARD_CACHE_BITS)];
+#endif
+
   uint8_t data[STATE_SIZE_BYTES];
 
 #if PACK_STATE
@@ -1072,7 +1358,7 @@ static void state_bound_set(struct state *NONNULL s, uint64_t bound) {
 }
 #endif
 
-#if COUNTEREXAMPLE_TRACE != CEX_OFF || LIVENESS_COUNT > 0
+#if PREVIOUS_POINTERS
 #if PACK_STATE
 static struct handle state_previous_handle(const struct state *NONNULL s) {
 
@@ -1246,6 +1532,10 @@ static struct state *state_new(void) {
       }
 
       arena_limit = arena_base + arena_count;
+#if LIVE_COUNTERS
+      telemetry_add(&telemetry[thread_id].arena_bytes,
+        arena_count * sizeof(*arena_base));
+#endif
       break;
     }
   }
@@ -1333,7 +1623,7 @@ static void print_allocation_summary(void) {
 /******************************************************************************/
 
 /* Print a counterexample trace terminating at the given state. This function
- * assumes that the caller already holds a lock on stdout.
+ * assumes that the caller has already begun an output record.
  */
 static void print_counterexample(
   const struct state *NONNULL s __attribute__((unused)));
@@ -1344,18 +1634,162 @@ static void print_counterexample(
  */
 static _Noreturn int exit_with(int status);
 
+#if DEDUPLICATE_ERRORS
+/* A class of errors, those reporting the same message. As a message names the
+ * violated property or the rule and expression that failed, repeats are the
+ * same problem reached via different states. Only the first of each class is
+ * reported with a counterexample trace and the rest are just counted.
+ */
+struct error_class {
+  char *message;
+  uint64_t hash;
+  unsigned long occurrences;
+};
+
+static struct error_class *error_classes;
+static size_t error_classes_count;
+static size_t error_classes_capacity;
+static pthread_mutex_t error_classes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Count an occurrence of an error, returning true if it is the first of its
+ * class.
+ */
+static bool error_class_record(const char *NONNULL message) {
+
+  /* FNV-1a, to avoid comparing the text of most non-matching messages */
+  uint64_t hash = UINT64_C(14695981039346656037);
+  for (const char *p = message; *p != '\0'; p++) {
+    hash = (hash ^ (uint64_t)(unsigned char)*p) * UINT64_C(1099511628211);
+  }
+
+  int r = pthread_mutex_lock(&error_classes_lock);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(r));
+    exit(EXIT_FAILURE);
+  }
+
+  bool first = true;
+  for (size_t i = 0; i < error_classes_count; i++) {
+    if (error_classes[i].hash == hash
+        && strcmp(error_classes[i].message, message) == 0) {
+      error_classes[i].occurrences++;
+      first = false;
+      break;
+    }
+  }
+
+  if (first) {
+    if (error_classes_count == error_classes_capacity) {
+      error_classes_capacity = error_classes_capacity == 0 ? 8
+        : error_classes_capacity * 2;
+      error_classes = xrealloc(error_classes,
+        error_classes_capacity * sizeof(error_classes[0]));
+    }
+    size_t length = strlen(message);
+    char *copy = xmalloc(length + 1);
+    memcpy(copy, message, length + 1);
+    error_classes[error_classes_count] = (struct error_class){
+      .message = copy, .hash = hash, .occurrences = 1 };
+    error_classes_count++;
+  }
+
+  r = pthread_mutex_unlock(&error_classes_lock);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(r));
+    exit(EXIT_FAILURE);
+  }
+
+  return first;
+}
+
+static void print_error_classes(void) {
+
+  if (error_classes_count == 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < error_classes_count; i++) {
+    if (MACHINE_READABLE_OUTPUT) {
+      put("<error_class message=\"");
+      xml_printf(error_classes[i].message);
+      put("\" occurrences=\"");
+      put_uint(error_classes[i].occurrences);
+      put("\"/>\n");
+    } else {
+      put("\t");
+      put_uint(error_classes[i].occurrences);
+      put(error_classes[i].occurrences == 1 ? " occurrence of: "
+        : " occurrences of: ");
+      put(error_classes[i].message);
+      put("\n");
+    }
+  }
+  if (!MACHINE_READABLE_OUTPUT) {
+    put("\n");
+  }
+}
+#endif
+
 static __attribute__((format(printf, 2, 3))) _Noreturn void error(
   const struct state *NONNULL s, const char *NONNULL fmt, ...) {
 
+#if TRACE_REPLAY
+  if (replaying) {
+    /* Errors while reconstructing a trace were either already reported or will
+     * be found by exploration. Just discard the state being generated.
+     */
+    siglongjmp(checkpoint, 1);
+  }
+#endif
+
+  /* Format the message, into a stack buffer unless it is unusually long. */
+  char small[256];
+  char *message = small;
+  {
+    va_list ap;
+    va_start(ap, fmt);
+
+    va_list ap2;
+    va_copy(ap2, ap);
+    int size = vsnprintf(small, sizeof(small), fmt, ap2);
+    va_end(ap2);
+    if (__builtin_expect(size < 0, 0)) {
+      fputs("vsnprintf failed", stderr);
+      exit(EXIT_FAILURE);
+    }
+
+    if ((size_t)size >= sizeof(small)) {
+      message = xmalloc((size_t)size + 1);
+      if (__builtin_expect(vsnprintf(message, (size_t)size + 1, fmt, ap) != size, 0)) {
+        fputs("vsnprintf failed", stderr);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    va_end(ap);
+  }
+
+#if DEDUPLICATE_ERRORS
+  if (!error_class_record(message)) {
+    /* A repeat of an error already reported. This does not count towards
+     * MAX_ERRORS, so keep checking if we can.
+     */
+    if (message != small) {
+      free(message);
+    }
+    if (MAX_ERRORS > 1) {
+      siglongjmp(checkpoint, 1);
+    }
+    exit_with(EXIT_FAILURE);
+  }
+#endif
+
   unsigned long prior_errors = __atomic_fetch_add(&error_count, 1,
     __ATOMIC_SEQ_CST);
 
   if (__builtin_expect(prior_errors < MAX_ERRORS, 1)) {
 
-    flockfile(stdout);
-
-    va_list ap;
-    va_start(ap, fmt);
+    output_begin();
 
     if (MACHINE_READABLE_OUTPUT) {
       put("<error includes_trace=\"");
@@ -1363,26 +1797,7 @@ static __attribute__((format(printf, 2, 3))) _Noreturn void error(
       put("\">\n");
 
       put("<message>");
-      {
-        va_list ap2;
-        va_copy(ap2, ap);
-
-        int size = vsnprintf(NULL, 0, fmt, ap2);
-        va_end(ap2);
-        if (__builtin_expect(size < 0, 0)) {
-          fputs("vsnprintf failed", stderr);
-          exit(EXIT_FAILURE);
-        }
-
-        char *buffer = xmalloc(size + 1);
-        if (__builtin_expect(vsnprintf(buffer, size + 1, fmt, ap) != size, 0)) {
-          fputs("vsnprintf failed", stderr);
-          exit(EXIT_FAILURE);
-        }
-
-        xml_printf(buffer);
-        free(buffer);
-      }
+      xml_printf(message);
       put("</message>\n");
 
       if (s != NULL && COUNTEREXAMPLE_TRACE != CEX_OFF) {
@@ -1399,26 +1814,7 @@ static __attribute__((format(printf, 2, 3))) _Noreturn void error(
       }
 
       put("\t"); put(red()); put(bold());
-      {
-        va_list ap2;
-        va_copy(ap2, ap);
-
-        int size = vsnprintf(NULL, 0, fmt, ap2);
-        va_end(ap2);
-        if (__builtin_expect(size < 0, 0)) {
-          fputs("vsnprintf failed", stderr);
-          exit(EXIT_FAILURE);
-        }
-
-        char *buffer = xmalloc(size + 1);
-        if (__builtin_expect(vsnprintf(buffer, size + 1, fmt, ap) != size, 0)) {
-          fputs("vsnprintf failed", stderr);
-          exit(EXIT_FAILURE);
-        }
-
-        put(buffer);
-        free(buffer);
-      }
+      put(message);
       put(reset()); put("\n\n");
 
       if (s != NULL && COUNTEREXAMPLE_TRACE != CEX_OFF) {
@@ -1427,9 +1823,11 @@ static __attribute__((format(printf, 2, 3))) _Noreturn void error(
       }
     }
 
-    va_end(ap);
+    output_end();
+  }
 
-    funlockfile(stdout);;
+  if (message != small) {
+    free(message);
   }
 
 #ifdef __clang__
@@ -1454,31 +1852,128 @@ static __attribute__((format(printf, 2, 3))) _Noreturn void error(
 }
 
 static void deadlock(const struct state *NONNULL s) {
-  if (JMP_BUF_NEEDED) {
-    if (sigsetjmp(checkpoint, 0)) {
-      /* error() longjmped back to us. */
-      return;
-    }
-  }
   error(s, "deadlock");
 }
 
-static int state_cmp(const struct state *NONNULL a,
+/* Progress of this thread through expanding a state. Each step of an expansion
+ * (evaluating a cached guard, trying a rule instance, checking for deadlock) is
+ * numbered in the order the generated explore() performs it. When an error or
+ * failed assumption unwinds to explore()'s checkpoint, it re-enters the same
+ * state's expansion and skips the steps it has already taken, rather than every
+ * rule paying to set a checkpoint of its own.
+ */
+struct expansion {
+  const struct state *state; /* state being expanded, or NULL between states */
+  uint64_t step;             /* number of the step being taken */
+  uint64_t done;             /* steps numbered up to this one are complete */
+  struct state *successor;   /* state being generated, if not yet in the seen set */
+  bool possible_deadlock;    /* whether no rule has yet made progress */
+};
+static _Thread_local struct expansion expansion;
+
+static void expansion_begin(const struct state *NONNULL s) {
+  expansion = (struct expansion){ .state = s, .possible_deadlock = true };
+}
+
+/* Called after unwinding to explore()'s checkpoint. */
+static void expansion_resume(void) {
+  assert(expansion.state != NULL && "unwound outside of expanding a state");
+
+  /* Discard the successor the interrupted step was generating. This was the
+   * most recent state allocated, so can be freed even when using the arena.
+   */
+  if (expansion.successor != NULL) {
+    state_free(expansion.successor);
+    expansion.successor = NULL;
+  }
+
+  expansion.done = expansion.step;
+  expansion.step = 0;
+}
+
+/* Read up to a word of a state's data, starting at the given byte offset. Any
+ * bytes beyond `extent` read as 0.
+ */
+static uint64_t state_word(const struct state *NONNULL s, size_t offset,
+    size_t extent) {
+
+  ASSERT(extent <= sizeof(uint64_t));
+  ASSERT(offset + extent <= sizeof(s->data));
+
+  uint64_t w = 0;
+  memcpy(&w, &s->data[offset], extent);
+  return w;
+}
+
+/* The following comparisons work a word at a time instead of calling out to
+ * libc. The size of the state data is a constant in the generated verifier, so
+ * the compiler can unroll these loops into a fixed sequence of loads and
+ * compares specialised to this model.
+ */
+
+static __attribute__((unused)) int state_cmp(const struct state *NONNULL a,
     const struct state *NONNULL b) {
-  return memcmp(a->data, b->data, sizeof(a->data));
+
+  for (size_t i = 0; i < sizeof(a->data); i += sizeof(uint64_t)) {
+
+    size_t extent = sizeof(a->data) - i;
+    if (extent > sizeof(uint64_t)) {
+      extent = sizeof(uint64_t);
+    }
+
+    uint64_t x = state_word(a, i, extent);
+    uint64_t y = state_word(b, i, extent);
+
+    if (x != y) {
+      /* Compare the words as big endian values in order to give the same
+       * ordering as memcmp. Symmetry reduction relies on this being a stable
+       * ordering of the state data.
+       */
+      if (!is_big_endian()) {
+        x = __builtin_bswap64(x);
+        y = __builtin_bswap64(y);
+      }
+      return x < y ? -1 : 1;
+    }
+  }
+
+  return 0;
 }
 
 static bool state_eq(const struct state *NONNULL a,
     const struct state *NONNULL b) {
-  return state_cmp(a, b) == 0;
+#if INCREMENTAL_HASH
+  /* states with differing hashes cannot be equal */
+  if (a->hash != b->hash) {
+    return false;
+  }
+#endif
+
+  for (size_t i = 0; i < sizeof(a->data); i += sizeof(uint64_t)) {
+
+    size_t extent = sizeof(a->data) - i;
+    if (extent > sizeof(uint64_t)) {
+      extent = sizeof(uint64_t);
+    }
+
+    if (state_word(a, i, extent) != state_word(b, i, extent)) {
+      return false;
+    }
+  }
+
+  return true;
 }
 
-static void handle_copy(struct handle a, struct handle b);
+static void handle_copy(const struct state *NONNULL s, struct handle a,
+    struct handle b);
 
 static struct state *state_dup(const struct state *NONNULL s) {
   struct state *n = state_new();
   memcpy(n->data, s->data, sizeof(n->data));
-#if COUNTEREXAMPLE_TRACE != CEX_OFF || LIVENESS_COUNT > 0
+#if INCREMENTAL_HASH
+  n->hash = s->hash;
+#endif
+#if PREVIOUS_POINTERS
   state_previous_set(n, s);
 #endif
 #if BOUND > 0
@@ -1488,43 +1983,158 @@ static struct state *state_dup(const struct state *NONNULL s) {
 #if LIVENESS_COUNT > 0
   memset(n->liveness, 0, sizeof(n->liveness));
 #endif
+#if GUARD_CACHE_BITS > 0
+  memset(n->guards_known, 0, sizeof(n->guards_known));
+#endif
 
   if (USE_SCALARSET_SCHEDULES) {
     /* copy schedule data related to past scalarset permutations */
     struct handle sch_src = state_schedule_handle(s, 0, SCHEDULE_BITS);
     struct handle sch_dst = state_schedule_handle(n, 0, SCHEDULE_BITS);
-    handle_copy(sch_dst, sch_src);
+    handle_copy(n, sch_dst, sch_src);
   }
 
   return n;
 }
 
-static size_t state_hash(const struct state *NONNULL s) {
-  return (size_t)MurmurHash64A(s->data, sizeof(s->data));
+static __attribute__((unused)) bool bitmap_get(const uint8_t *NONNULL bitmap,
+    size_t index) {
+  return (bitmap[index / CHAR_BIT] >> (index % CHAR_BIT)) & 1;
 }
 
-#if COUNTEREXAMPLE_TRACE != CEX_OFF
-static __attribute__((unused)) size_t state_depth(
-    const struct state *NONNULL s) {
-#if BOUND > 0
-  uint64_t bound = state_bound_get(s);
-  ASSERT(bound <= BOUND && "claimed state bound exceeds limit");
-  return (size_t)bound + 1;
-#else
-  size_t d = 0;
-  while (s != NULL) {
-    d++;
-    s = state_previous_get(s);
+static __attribute__((unused)) void bitmap_set(uint8_t *NONNULL bitmap,
+    size_t index, bool value) {
+  if (value) {
+    bitmap[index / CHAR_BIT] |= (uint8_t)(1u << (index % CHAR_BIT));
+  } else {
+    bitmap[index / CHAR_BIT] &= (uint8_t)~(1u << (index % CHAR_BIT));
   }
-  return d;
-#endif
 }
-#endif
 
-/* A type-safe const cast. */
-static __attribute__((unused)) struct state *state_drop_const(const struct state *s) {
-  return (struct state*)s;
-}
+#if GUARD_CACHE_BITS > 0
+/* Seed the (empty) guard cache of a successor `n` from that of its
+ * predecessor. The guards of rule `j` (covering instances `start[j]` to
+ * `start[j + 1]`) are carried across when bit `j` of `unaffected` is set,
+ * meaning the rule that produced `n` writes nothing those guards read. All
+ * other results are left unknown and will be recomputed when `n` is expanded.
+ */
+static void guard_cache_inherit(struct state *NONNULL n,
+    const uint8_t *NONNULL known, const uint8_t *NONNULL enabled,
+    const uint8_t *NONNULL unaffected, const size_t *NONNULL start,
+    size_t rule_count) {
+
+  for (size_t j = 0; j < rule_count; j++) {
+    if (!bitmap_get(unaffected, j)) {
+      continue;
+    }
+    for (size_t k = start[j]; k < start[j + 1]; k++) {
+      if (bitmap_get(known, k)) {
+        bitmap_set(n->guards_known, k, true);
+        bitmap_set(n->guards_enabled, k, bitmap_get(enabled, k));
+      }
+    }
+  }
+}
+#endif
+
+#if INCREMENTAL_HASH
+/* Zobrist key for bit `index` of a state's data. Instead of a table of random
+ * values, each key is derived by scrambling the bit index with the SplitMix64
+ * finaliser. This costs a few multiplications per changed bit but avoids a
+ * table that would be as large as the state itself times 64.
+ */
+static uint64_t hash_key(size_t index) {
+  uint64_t z = (uint64_t)index + UINT64_C(0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+  return z ^ (z >> 31);
+}
+
+/* combined Zobrist key of the bits set in `bits`, the lowest of which is bit
+ * `index` of a state's data
+ */
+static uint64_t hash_bits(size_t index, uint64_t bits) {
+  uint64_t h = 0;
+  while (bits != 0) {
+    h ^= hash_key(index + (size_t)__builtin_ctzll(bits));
+    bits &= bits - 1;
+  }
+  return h;
+}
+
+/* compute the hash of a state from scratch */
+static __attribute__((unused)) uint64_t state_hash_full(
+    const struct state *NONNULL s) {
+  uint64_t h = 0;
+  for (size_t i = 0; i < sizeof(s->data); i++) {
+    h ^= hash_bits(i * CHAR_BIT, s->data[i]);
+  }
+  return h;
+}
+
+/* does the given handle refer to the data of the given state? */
+static bool handle_in_state(const struct state *NONNULL s, struct handle h) {
+  uintptr_t base = (uintptr_t)s->data;
+  uintptr_t p = (uintptr_t)h.base;
+  return p >= base && p < base + sizeof(s->data);
+}
+
+/* combined Zobrist key of the bits currently set within a handle into the given
+ * state, or 0 if the handle points elsewhere
+ */
+static uint64_t handle_hash_bits(const struct state *NONNULL s,
+    struct handle h) {
+
+  if (!handle_in_state(s, h)) {
+    return 0;
+  }
+
+  size_t index = (size_t)(h.base - s->data) * CHAR_BIT + h.offset;
+
+  uint64_t hash = 0;
+  for (size_t i = 0; i < h.width; i += 64) {
+    struct handle chunk = {
+      .base = h.base + (h.offset + i) / CHAR_BIT,
+      .offset = (h.offset + i) % CHAR_BIT,
+      .width = h.width - i < 64 ? h.width - i : 64,
+    };
+    hash ^= hash_bits(index + i, read_raw(chunk));
+  }
+  return hash;
+}
+#endif
+
+static size_t state_hash(const struct state *NONNULL s) {
+#if INCREMENTAL_HASH
+  assert(s->hash == state_hash_full(s) && "incremental state hash is stale");
+  return (size_t)s->hash;
+#else
+  return (size_t)MurmurHash64A(s->data, sizeof(s->data));
+#endif
+}
+
+#if COUNTEREXAMPLE_TRACE != CEX_OFF && PREVIOUS_POINTERS
+static __attribute__((unused)) size_t state_depth(
+    const struct state *NONNULL s) {
+#if BOUND > 0
+  uint64_t bound = state_bound_get(s);
+  ASSERT(bound <= BOUND && "claimed state bound exceeds limit");
+  return (size_t)bound + 1;
+#else
+  size_t d = 0;
+  while (s != NULL) {
+    d++;
+    s = state_previous_get(s);
+  }
+  return d;
+#endif
+}
+#endif
+
+/* A type-safe const cast. */
+static __attribute__((unused)) struct state *state_drop_const(const struct state *s) {
+  return (struct state*)s;
+}
 
 /* These functions are generated. */
 static void state_canonicalise_heuristic(struct state *NONNULL s);
@@ -1554,23 +2164,193 @@ static void state_canonicalise(struct state *NONNULL s) {
 static __attribute__((unused)) void state_print_field_offsets(void);
 
 /* Print a state to stderr. This function is generated. This function assumes
- * that the caller already holds a lock on stdout.
+ * that the caller has already begun an output record.
  */
 static __attribute__((unused)) void state_print(const struct state *previous,
   const struct state *NONNULL s);
 
-/* Print the first rule that resulted in s. This function is generated. This
- * function assumes that the caller holds a lock on stdout.
+/* Print the first rule that resulted in s from previous, which is NULL if s is
+ * a start state. This function is generated. This function assumes that the
+ * caller has already begun an output record.
  */
 static __attribute__((unused)) void print_transition(
-    const struct state *NONNULL s);
+    const struct state *previous, const struct state *NONNULL s);
+
+#if TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF
+/*******************************************************************************
+ * Trace reconstruction                                                        *
+ *                                                                             *
+ * With --trace-replay, states do not record their predecessor. To print a     *
+ * counterexample trace, we instead search breadth-first from the start states *
+ * for the state in question, firing rules again. The states found by this     *
+ * search are kept in private memory with a link to their parent, so the       *
+ * search does not interfere with any ongoing exploration.                     *
+ ******************************************************************************/
+
+struct replay_node {
+  struct state *state;
+  size_t parent; /* index of the parent node, or SIZE_MAX for start states */
+};
+
+struct replay {
+  const struct state *target; /* state we are searching for */
+  size_t found;               /* node matching the target (SIZE_MAX if none) */
+  size_t parent;              /* node being expanded (SIZE_MAX for none) */
+
+  struct replay_node *nodes;
+  size_t count;
+  size_t capacity;
+
+  /* open-addressed hash table of node indices + 1, with 0 for empty */
+  size_t *table;
+  size_t table_size;
+};
+
+/* The state this thread is currently expanding during exploration, if any.
+ * Errors found during expansion are reported against a successor of this.
+ */
+static _Thread_local const struct state *replay_expanding;
+
+/* Whether this thread is generating start states. Errors found then are
+ * reported against a start state.
+ */
+static _Thread_local bool replay_initialising;
+
+/* Generate the successors of a state, or the start states if `s` is NULL,
+ * passing each to replay_visit(). This function is generated.
+ */
+static void replay_expand(const struct state *s, struct replay *NONNULL r);
+
+static void replay_insert(struct replay *NONNULL r, size_t node) {
+  size_t i = state_hash(r->nodes[node].state) & (r->table_size - 1);
+  while (r->table[i] != 0) {
+    i = (i + 1) & (r->table_size - 1);
+  }
+  r->table[i] = node + 1;
+}
+
+/* Note a state found by the search, returning true if it is the target. */
+static __attribute__((unused)) bool replay_visit(struct replay *NONNULL r,
+    const struct state *NONNULL n) {
+
+  /* keep the hash table at most half full */
+  if ((r->count + 1) * 2 > r->table_size) {
+    free(r->table);
+    r->table_size = r->table_size == 0 ? 1024 : r->table_size * 2;
+    r->table = xcalloc(r->table_size, sizeof(r->table[0]));
+    for (size_t i = 0; i < r->count; i++) {
+      replay_insert(r, i);
+    }
+  }
+
+  /* have we seen this state before? */
+  for (size_t i = state_hash(n) & (r->table_size - 1); r->table[i] != 0;
+       i = (i + 1) & (r->table_size - 1)) {
+    if (state_eq(r->nodes[r->table[i] - 1].state, n)) {
+      return false;
+    }
+  }
+
+  if (r->count == r->capacity) {
+    r->capacity = r->capacity == 0 ? 1024 : r->capacity * 2;
+    r->nodes = xrealloc(r->nodes, r->capacity * sizeof(r->nodes[0]));
+  }
+
+  /* Take a private copy of the state. The original comes from the calling
+   * thread's arena, from which it will be freed.
+   */
+  struct state *copy = xmalloc(sizeof(*copy));
+  memcpy(copy, n, sizeof(*copy));
+  r->nodes[r->count] = (struct replay_node){ .state = copy, .parent = r->parent };
+  replay_insert(r, r->count);
+  r->count++;
+
+  if (state_eq(n, r->target)) {
+    r->found = r->count - 1;
+    return true;
+  }
+  return false;
+}
+
+/* Search for a shortest path from a start state to `target`. */
+static void replay_search(struct replay *NONNULL r,
+    const struct state *NONNULL target) {
+
+  *r = (struct replay){ .target = target, .found = SIZE_MAX,
+    .parent = SIZE_MAX };
+
+  /* Firing rules may longjmp on error, so save the checkpoint of whatever
+   * called us and restore it afterwards.
+   */
+  sigjmp_buf saved;
+  memcpy(&saved, &checkpoint, sizeof(saved));
+  replaying = true;
+
+  replay_expand(NULL, r);
+  for (size_t i = 0; r->found == SIZE_MAX && i < r->count; i++) {
+#if BOUND > 0
+    if (state_bound_get(r->nodes[i].state) == BOUND) {
+      /* it is not valid to expand beyond the bound */
+      continue;
+    }
+#endif
+    r->parent = i;
+    replay_expand(r->nodes[i].state, r);
+  }
+
+  replaying = false;
+  memcpy(&checkpoint, &saved, sizeof(saved));
+}
+
+static void replay_free(struct replay *NONNULL r) {
+  for (size_t i = 0; i < r->count; i++) {
+    free(r->nodes[i].state);
+  }
+  free(r->nodes);
+  free(r->table);
+}
+#endif
 
 static void print_counterexample(
     const struct state *NONNULL s __attribute__((unused))) {
 
   assert(s != NULL && "missing state in request for counterexample trace");
 
-#if COUNTEREXAMPLE_TRACE != CEX_OFF
+#if COUNTEREXAMPLE_TRACE != CEX_OFF && TRACE_REPLAY
+  /* Construct an array of the states we need to print by searching from the
+   * start states. A state generated while initialising is itself a start
+   * state. A state generated while expanding another need not be in the seen
+   * set, so we search for the state being expanded and append `s`.
+   */
+  struct replay r = { .found = SIZE_MAX };
+  const bool append = !replay_initialising && replay_expanding != NULL
+    && replay_expanding != s;
+  if (!replay_initialising) {
+    replay_search(&r, append ? replay_expanding : s);
+    ASSERT(r.found != SIZE_MAX && "state in counterexample trace not found");
+  }
+
+  size_t trace_length = append || r.found == SIZE_MAX ? 1 : 0;
+  for (size_t i = r.found; i != SIZE_MAX; i = r.nodes[i].parent) {
+    trace_length++;
+  }
+
+  const struct state **cex = xcalloc(trace_length, sizeof(cex[0]));
+
+  {
+    size_t i = trace_length - 1;
+    if (append || r.found == SIZE_MAX) {
+      cex[i] = s;
+      i--;
+    }
+    for (size_t j = r.found; j != SIZE_MAX; j = r.nodes[j].parent) {
+      assert(i < trace_length && "error in counterexample trace traversal "
+        "logic");
+      cex[i] = r.nodes[j].state;
+      i--;
+    }
+  }
+#elif COUNTEREXAMPLE_TRACE != CEX_OFF
   /* Construct an array of the states we need to print by walking backwards to
    * the initial starting state.
    */
@@ -1587,13 +2367,16 @@ static void print_counterexample(
       i--;
     }
   }
+#endif
+
+#if COUNTEREXAMPLE_TRACE != CEX_OFF
 
   for (size_t i = 0; i < trace_length; i++) {
 
     const struct state *current = cex[i];
     const struct state *previous = i == 0 ? NULL : cex[i - 1];
 
-    print_transition(current);
+    print_transition(previous, current);
 
     if (MACHINE_READABLE_OUTPUT) {
       put("<state>\n");
@@ -1607,6 +2390,9 @@ static void print_counterexample(
   }
 
   free(cex);
+#if TRACE_REPLAY
+  replay_free(&r);
+#endif
 #endif
 }
 
@@ -1712,6 +2498,18 @@ static void handle_write_raw(const struct state *NONNULL s, struct handle h,
   #pragma GCC diagnostic pop
 #endif
 
+#if INCREMENTAL_HASH
+  /* fold the bits this write is about to flip into the state's hash */
+  if (handle_in_state(s, h)) {
+    uint64_t diff = read_raw(h) ^ (uint64_t)value;
+    if (h.width < 64) {
+      diff &= (UINT64_C(1) << h.width) - 1;
+    }
+    size_t index = (size_t)(h.base - s->data) * CHAR_BIT + h.offset;
+    state_drop_const(s)->hash ^= hash_bits(index, diff);
+  }
+#endif
+
   write_raw(h, (uint64_t)value);
 }
 
@@ -1740,7 +2538,244 @@ static __attribute__((unused)) void handle_write(const char *NONNULL context,
   handle_write_raw(s, h, r);
 }
 
-static __attribute__((unused)) void handle_zero(struct handle h) {
+/* The following are counterparts of handle_read() and handle_write() for when
+ * the location of a state component is known at the time the verifier is
+ * generated. The offset and width arguments are constants at every call site,
+ * so once inlined the compiler can reduce each access to a single load or
+ * store with constant shifts and masks, rather than building a handle and
+ * branching on its alignment.
+ */
+
+static inline __attribute__((always_inline)) uint64_t read_fixed(
+    const struct state *NONNULL s, size_t offset, size_t width) {
+
+  ASSERT(width <= 64 && "read of too wide value");
+  ASSERT(sizeof(s->data) * CHAR_BIT - width >= offset
+    && "out of bounds read in read_fixed()");
+
+  if (width == 0) {
+    return 0;
+  }
+
+  /* fall back to the generic path for values that straddle more than a word */
+  size_t extent = BITS_TO_BYTES(offset % CHAR_BIT + width);
+  if (extent > sizeof(uint64_t)) {
+    return read_raw(state_handle(s, offset, width));
+  }
+
+  uint64_t v = copy_out64(&s->data[offset / CHAR_BIT], extent);
+  v >>= offset % CHAR_BIT;
+  if (width < 64) {
+    v &= (UINT64_C(1) << width) - 1;
+  }
+  return v;
+}
+
+static inline __attribute__((always_inline)) void write_fixed(
+    struct state *NONNULL s, size_t offset, size_t width, uint64_t v) {
+
+  ASSERT(width <= 64 && "write of too wide value");
+  ASSERT(sizeof(s->data) * CHAR_BIT - width >= offset
+    && "out of bounds write in write_fixed()");
+
+  if (width == 0) {
+    return;
+  }
+
+  /* fall back to the generic path for values that straddle more than a word */
+  size_t extent = BITS_TO_BYTES(offset % CHAR_BIT + width);
+  if (extent > sizeof(uint64_t)) {
+    write_raw(state_handle(s, offset, width), v);
+    return;
+  }
+
+  uint64_t mask = width < 64 ? (UINT64_C(1) << width) - 1 : UINT64_MAX;
+  mask <<= offset % CHAR_BIT;
+
+  uint8_t *p = &s->data[offset / CHAR_BIT];
+  uint64_t x = copy_out64(p, extent);
+  x = (x & ~mask) | ((v << (offset % CHAR_BIT)) & mask);
+  copy_in64(p, x, extent);
+}
+
+static __attribute__((unused)) value_t state_read(const char *NONNULL context,
+    const char *rule_name, const char *NONNULL name,
+    const struct state *NONNULL s, value_t lb, value_t ub, size_t offset,
+    size_t width) {
+
+  assert(context != NULL);
+  assert(name != NULL);
+
+  if (__builtin_expect(width > sizeof(raw_value_t) * 8, 0)) {
+    error(s, "read of a handle that is wider than the value type");
+  }
+
+  raw_value_t dest = (raw_value_t)read_fixed(s, offset, width);
+
+  TRACE(TC_HANDLE_READS, "read value %" PRIRAWVAL " from handle { %p, %zu, %zu }",
+    raw_value_to_string(dest), &s->data[offset / CHAR_BIT],
+    offset % CHAR_BIT, width);
+
+  if (__builtin_expect(dest == 0, 0)) {
+    error(s, "%sread of undefined value in %s%s%s", context, name,
+      rule_name == NULL ? "" : " within ", rule_name == NULL ? "" : rule_name);
+  }
+
+  return decode_value(lb, ub, dest);
+}
+
+/* Variants of state_read() and handle_read() for values read more than once
+ * within an expression that cannot change the state. The first read stores
+ * the value in `*cached` and subsequent reads reuse it. Reading lazily like
+ * this, rather than once up front, preserves which reads are reached and so
+ * which errors are reported.
+ */
+static inline __attribute__((always_inline, unused)) value_t state_read_once(
+    bool *NONNULL valid, value_t *NONNULL cached, const char *NONNULL context,
+    const char *rule_name, const char *NONNULL name,
+    const struct state *NONNULL s, value_t lb, value_t ub, size_t offset,
+    size_t width) {
+
+  if (!*valid) {
+    *cached = state_read(context, rule_name, name, s, lb, ub, offset, width);
+    *valid = true;
+  }
+  return *cached;
+}
+
+static inline __attribute__((always_inline, unused)) value_t handle_read_once(
+    bool *NONNULL valid, value_t *NONNULL cached, const char *NONNULL context,
+    const char *rule_name, const char *NONNULL name,
+    const struct state *NONNULL s, value_t lb, value_t ub, struct handle h) {
+
+  if (!*valid) {
+    *cached = handle_read(context, rule_name, name, s, lb, ub, h);
+    *valid = true;
+  }
+  return *cached;
+}
+
+/* Whether a simple state component at a known location may hold the given
+ * (encoded) value. An undefined component may, in the sense that reading it
+ * would produce an error the caller should not pre-empt.
+ */
+static inline __attribute__((always_inline, unused)) bool state_may_equal(
+    const struct state *NONNULL s, size_t offset, size_t width,
+    raw_value_t expected) {
+
+  raw_value_t raw = (raw_value_t)read_fixed(s, offset, width);
+  return raw == 0 || raw == expected;
+}
+
+/* number of array elements state_scan_may_equal() examines at once */
+enum { SCAN_LANES = 8 };
+
+typedef uint64_t scan_lanes_t
+  __attribute__((vector_size(SCAN_LANES * sizeof(uint64_t))));
+
+/* Evaluate state_may_equal() for `count` elements of an array, the first at bit
+ * `base` of the state data and each subsequent one `stride` bits after its
+ * predecessor, setting the corresponding bits of `result`. Elements are
+ * unpacked and compared SCAN_LANES at a time using vector operations, which
+ * the compiler lowers to SIMD instructions where the target has them.
+ */
+static __attribute__((unused)) void state_scan_may_equal(
+    const struct state *NONNULL s, size_t base, size_t stride, size_t width,
+    raw_value_t expected, size_t count, uint8_t *NONNULL result) {
+
+  ASSERT(width > 0 && width <= 64 && "scan of an invalid width");
+
+  memset(result, 0, BITS_TO_BYTES(count));
+
+  size_t i = 0;
+
+  /* An element can be extracted from a single 64-bit load when it does not
+   * span more than 8 bytes, whatever its offset within its first byte.
+   */
+  if (width <= 64 - (CHAR_BIT - 1)) {
+    const scan_lanes_t zero = { 0 };
+    const scan_lanes_t mask = zero + ((UINT64_C(1) << width) - 1);
+    const scan_lanes_t want = zero + (uint64_t)expected;
+
+    for (; i + SCAN_LANES <= count; i += SCAN_LANES) {
+
+      /* stop if the last load would read beyond the end of the state */
+      size_t last = base + (i + SCAN_LANES - 1) * stride;
+      if (last / CHAR_BIT + sizeof(uint64_t) > sizeof(s->data)) {
+        break;
+      }
+
+      scan_lanes_t words;
+      scan_lanes_t shifts;
+      for (size_t j = 0; j < SCAN_LANES; j++) {
+        size_t offset = base + (i + j) * stride;
+        words[j] = copy_out64(&s->data[offset / CHAR_BIT], sizeof(uint64_t));
+        shifts[j] = offset % CHAR_BIT;
+      }
+
+      const scan_lanes_t raw = (words >> shifts) & mask;
+      const scan_lanes_t hit = (scan_lanes_t)((raw == zero) | (raw == want));
+
+      for (size_t j = 0; j < SCAN_LANES; j++) {
+        if (hit[j] != 0) {
+          bitmap_set(result, i + j, true);
+        }
+      }
+    }
+  }
+
+  /* handle any remaining elements one by one */
+  for (; i < count; i++) {
+    if (state_may_equal(s, base + i * stride, width, expected)) {
+      bitmap_set(result, i, true);
+    }
+  }
+}
+
+static __attribute__((unused)) void state_write(const char *NONNULL context,
+    const char *rule_name, const char *NONNULL name,
+    const struct state *NONNULL s, value_t lb, value_t ub, size_t offset,
+    size_t width, value_t value) {
+
+  assert(context != NULL);
+  assert(name != NULL);
+
+  if (__builtin_expect(width > sizeof(raw_value_t) * 8, 0)) {
+    error(s, "write of a handle that is wider than the value type");
+  }
+
+  raw_value_t r;
+  if (__builtin_expect(value < lb || value > ub || SUB(value, lb, &r)
+      || ADD(r, 1, &r), 0)) {
+    error(s, "%swrite of out-of-range value into %s%s%s", context, name,
+      rule_name == NULL ? "" : " within ", rule_name == NULL ? "" : rule_name);
+  }
+
+  TRACE(TC_HANDLE_WRITES, "writing value %" PRIRAWVAL " to handle { %p, %zu, %zu }",
+    raw_value_to_string(r), &s->data[offset / CHAR_BIT], offset % CHAR_BIT,
+    width);
+
+#if INCREMENTAL_HASH
+  /* fold the bits this write is about to flip into the state's hash */
+  {
+    uint64_t diff = read_fixed(s, offset, width) ^ (uint64_t)r;
+    if (width < 64) {
+      diff &= (UINT64_C(1) << width) - 1;
+    }
+    state_drop_const(s)->hash ^= hash_bits(offset, diff);
+  }
+#endif
+
+  write_fixed(state_drop_const(s), offset, width, (uint64_t)r);
+}
+
+static __attribute__((unused)) void handle_zero(
+    const struct state *NONNULL s __attribute__((unused)), struct handle h) {
+
+#if INCREMENTAL_HASH
+  /* all bits within the handle are about to be cleared */
+  state_drop_const(s)->hash ^= handle_hash_bits(s, h);
+#endif
 
   uint8_t *p = h.base + h.offset / 8;
 
@@ -1770,10 +2805,16 @@ static __attribute__((unused)) void handle_zero(struct handle h) {
   }
 }
 
-static void handle_copy(struct handle a, struct handle b) {
+static void handle_copy(const struct state *NONNULL s __attribute__((unused)),
+    struct handle a, struct handle b) {
 
   ASSERT(a.width == b.width && "copying between handles of different sizes");
 
+#if INCREMENTAL_HASH
+  /* remove the destination's current contribution to the state's hash */
+  state_drop_const(s)->hash ^= handle_hash_bits(s, a);
+#endif
+
   /* FIXME: This does a bit-by-bit copy which almost certainly could be
    * accelerated by detecting byte-boundaries and complementary alignment and
    * then calling memcpy when possible.
@@ -1792,6 +2833,11 @@ static void handle_copy(struct handle a, struct handle b) {
 
     *dst = (*dst & and_mask) | or_mask;
   }
+
+#if INCREMENTAL_HASH
+  /* add the destination's new contribution to the state's hash */
+  state_drop_const(s)->hash ^= handle_hash_bits(s, a);
+#endif
 }
 
 static __attribute__((unused)) bool handle_eq(struct handle a,
@@ -2904,10 +3950,11 @@ static void *refcounted_ptr_get(refcounted_ptr_t *NONNULL p) {
   return ret;
 }
 
-static void refcounted_ptr_put(refcounted_ptr_t *NONNULL p,
+static size_t refcounted_ptr_put(refcounted_ptr_t *NONNULL p,
   void *ptr __attribute__((unused))) {
 
   refcounted_ptr_t old, new;
+  size_t count;
   bool r;
 
   do {
@@ -2923,12 +3970,15 @@ static void refcounted_ptr_put(refcounted_ptr_t *NONNULL p,
     ASSERT(p2.count > 0 && "releasing a reference to a pointer when it had no "
       "outstanding references");
     p2.count--;
+    count = p2.count;
 
     /* Try to commit our results. */
     memcpy(&new, &p2, sizeof(new));
     r = atomic_cas(p, old, new);
   } while (!r);
-}
+
+  return count;
+}
 
 static void *refcounted_ptr_peek(refcounted_ptr_t *NONNULL p) {
 
@@ -2947,8 +3997,9 @@ static void *refcounted_ptr_peek(refcounted_ptr_t *NONNULL p) {
 static void refcounted_ptr_shift(refcounted_ptr_t *NONNULL current,
     refcounted_ptr_t *NONNULL next) {
 
-  /* None of the operations in this function are performed atomically because we
-   * assume the caller has synchronised with other threads via other means.
+  /* This function is not atomic as a whole because we assume the caller has
+   * synchronised with other threads' gets and puts via other means. Its writes
+   * are atomic though, so other threads can concurrently peek.
    */
 
   /* The pointer we're about to overwrite should not be referenced. */
@@ -2958,133 +4009,10 @@ static void refcounted_ptr_shift(refcounted_ptr_t *NONNULL current,
     "references");
 
   /* Shift the next value into the current pointer. */
-  *current = *next;
+  atomic_write(current, atomic_read(next));
 
   /* Blank the value we just shifted over. */
-  *next = 0;
-}
-
-/******************************************************************************/
-
-/*******************************************************************************
- * Thread rendezvous support                                                   *
- ******************************************************************************/
-
-static pthread_mutex_t rendezvous_lock; /* mutual exclusion mechanism for below. */
-static pthread_cond_t rendezvous_cond;  /* sleep mechanism for below. */
-static size_t running_count = 1;            /* how many threads are opted in to rendezvous? */
-static size_t rendezvous_pending = 1;   /* how many threads are opted in and not sleeping? */
-
-static void rendezvous_init(void) {
-  int r = pthread_mutex_init(&rendezvous_lock, NULL);
-  if (__builtin_expect(r != 0, 0)) {
-    fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(r));
-    exit(EXIT_FAILURE);
-  }
-
-  r = pthread_cond_init(&rendezvous_cond, NULL);
-  if (__builtin_expect(r != 0, 0)) {
-    fprintf(stderr, "pthread_cond_init failed: %s\n", strerror(r));
-    exit(EXIT_FAILURE);
-  }
-}
-
-/* Call this at the start of a rendezvous point.
- *
- * This is a low level function, not expected to be directly used outside of the
- * context of the rendezvous implementation.
- *
- * @return True if the caller was the last to arrive and henceforth dubbed the
- *   'leader'.
- */
-static bool rendezvous_arrive(void) {
-  int r __attribute__((unused)) = pthread_mutex_lock(&rendezvous_lock);
-  assert(r == 0);
-
-  /* Take a token from the rendezvous down-counter. */
-  assert(rendezvous_pending > 0);
-  rendezvous_pending--;
-
-  /* If we were the last to arrive then it was our arrival that dropped the
-   * counter to zero.
-   */
-  return rendezvous_pending == 0;
-}
-
-/* Call this at the end of a rendezvous point.
- *
- * This is a low level function, not expected to be directly used outside of the
- * context of the rendezvous implementation.
- *
- * @param leader Whether the caller is the 'leader'. If you call this when you
- *   are the 'leader' it will unblock all 'followers' at the rendezvous point.
- * @param action Optional code for the leader to run.
- */
-static void rendezvous_depart(bool leader, void (*action)(void)) {
-  int r __attribute((unused));
-
-  if (leader) {
-    if (action != NULL) {
-      action();
-    }
-
-    /* Reset the counter for the next rendezvous. */
-    assert(rendezvous_pending == 0 && "a rendezvous point is being exited "
-      "while some participating threads have yet to arrive");
-    rendezvous_pending = running_count;
-
-    /* Wake up the 'followers'. */
-    r = pthread_cond_broadcast(&rendezvous_cond);
-    assert(r == 0);
-
-  } else {
-
-    /* Wait on the 'leader' to wake us up. */
-    r = pthread_cond_wait(&rendezvous_cond, &rendezvous_lock);
-    assert(r == 0);
-  }
-
-  r = pthread_mutex_unlock(&rendezvous_lock);
-  assert(r == 0);
-}
-
-/* Exposed friendly function for performing a rendezvous. */
-static void rendezvous(void (*action)(void)) {
-  bool leader = rendezvous_arrive();
-  if (leader) {
-    TRACE(TC_SET, "arrived at rendezvous point as leader");
-  }
-  rendezvous_depart(leader, action);
-}
-
-/* Remove the caller from the pool of threads who participate in this
- * rendezvous.
- */
-static void rendezvous_opt_out(void (*action)(void)) {
-
-retry:;
-
-  /* "Arrive" at the rendezvous to decrement the count of outstanding threads.
-   */
-  bool leader = rendezvous_arrive();
-
-  if (leader && running_count > 1) {
-    /* We unfortunately opted out of this rendezvous while the remaining threads
-     * were arriving at one and we were the last to arrive. Let's pretend we are
-     * participating in the rendezvous and unblock them.
-     */
-    rendezvous_depart(true, action);
-
-    /* Re-attempt opting-out. */
-    goto retry;
-  }
-
-  /* Remove ourselves from the known threads. */
-  assert(running_count > 0);
-  running_count--;
-
-  int r __attribute__((unused)) = pthread_mutex_unlock(&rendezvous_lock);
-  assert(r == 0);
+  atomic_write(next, 0);
 }
 
 /******************************************************************************/
@@ -3134,8 +4062,15 @@ static slot_t state_to_slot(const struct state *s) {
  * elements.                                                                   *
  ******************************************************************************/
 
-enum { INITIAL_SET_SIZE_EXPONENT = sizeof(unsigned long long) * 8 - 1 -
-  __builtin_clzll(SET_CAPACITY / sizeof(struct state*) / sizeof(struct state)) };
+/* With --expected-states, use the smallest size that holds that many states
+ * while staying under the expansion threshold. Otherwise derive it from
+ * --set-capacity.
+ */
+enum { INITIAL_SET_SIZE_EXPONENT = EXPECTED_STATES > 0
+  ? sizeof(unsigned long long) * 8 -
+    __builtin_clzll(EXPECTED_STATES * 100 / SET_EXPAND_THRESHOLD)
+  : sizeof(unsigned long long) * 8 - 1 -
+    __builtin_clzll(SET_CAPACITY / sizeof(struct state*) / sizeof(struct state)) };
 
 struct set {
   slot_t *bucket;
@@ -3173,12 +4108,20 @@ static refcounted_ptr_t next_global_seen;
  * role of the reference counts of both 'global_seen' and 'next_global_seen' in
  * all of this is to detect when the last thread releases its reference to the
  * old seen set and hence can deallocate it.
+ *
+ * There is no point at which all threads stop and wait for each other. Each
+ * thread moves to the new set as soon as the migration is complete, the next
+ * time it tries to insert a state. Until the last thread has moved, the old set
+ * cannot be freed and the set cannot be expanded again, so threads that have
+ * moved keep inserting into the new set past the expansion threshold.
  */
 
-/* The next chunk to migrate from the old set to the new set. What exactly a
- * "chunk" is is covered in 'set_migrate'.
+/* The next chunk to migrate from the old set to the new set, and the number of
+ * chunks whose migration is complete. What exactly a "chunk" is is covered in
+ * 'set_migrate'.
  */
 static size_t next_migration;
+static size_t migrated_chunks;
 
 /* A mechanism for synchronisation in 'set_expand'. */
 static pthread_mutex_t set_expand_mutex;
@@ -3214,6 +4157,9 @@ static void set_init(void) {
   struct set *set = xmalloc(sizeof(*set));
   set->size_exponent = INITIAL_SET_SIZE_EXPONENT;
   set->bucket = xcalloc(set_size(set), sizeof(set->bucket[0]));
+#if LIVE_COUNTERS
+  __atomic_store_n(&telemetry_set_slots, set_size(set), __ATOMIC_RELAXED);
+#endif
 
   /* Stash this somewhere for threads to later retrieve it from. Note that we
    * initialize its reference count to zero as we (the setup logic) are not
@@ -3227,27 +4173,47 @@ static void set_thread_init(void) {
   local_seen = refcounted_ptr_get(&global_seen);
 }
 
-static void set_update(void) {
-  /* Guard against the case where we've been called from exit_with() and we're
-   * not finishing a migration, but just opting out of the rendezvous protocol.
+/* Release a reference to a seen set, the old or the new one if we are part way
+ * through an expansion.
+ */
+static void set_release(struct set *NONNULL set) {
+
+  /* Exclude expansion and other releases, as we may need to shift the global
+   * pointers.
    */
-  if (refcounted_ptr_peek(&next_global_seen) != NULL) {
+  set_expand_lock();
+
+  if (set != refcounted_ptr_peek(&global_seen)) {
+    ASSERT(set == refcounted_ptr_peek(&next_global_seen)
+      && "releasing a reference to an unknown set");
+    (void)refcounted_ptr_put(&next_global_seen, set);
 
-    /* Clean up the old set. Note that we are using a pointer we have already
-     * given up our reference count to here, but we rely on the caller to ensure
-     * this access is safe.
+  } else if (refcounted_ptr_put(&global_seen, set) == 0
+      && refcounted_ptr_peek(&next_global_seen) != NULL) {
+    /* We were the last thread using a set that has been migrated. Every thread
+     * releasing it either finished migrating or held no chunks, so the
+     * migration is complete and no one needs the old set.
      */
-    free(local_seen->bucket);
-    free(local_seen);
+    TRACE(TC_SET, "last thread left the old set, freeing it");
+    free(set->bucket);
+    free(set);
 
     /* Reset migration state for the next time we expand the set. */
     next_migration = 0;
+    migrated_chunks = 0;
 
-    /* Update the global pointer to the new set. We know all the above
-     * migrations have completed and no one needs the old set.
-     */
+    /* Update the global pointer to the new set. */
     refcounted_ptr_shift(&global_seen, &next_global_seen);
   }
+
+  set_expand_unlock();
+}
+
+/* Whether the seen set is being expanded and we are yet to move to the new one.
+ */
+static bool set_migration_pending(void) {
+  const struct set *next = refcounted_ptr_peek(&next_global_seen);
+  return next != NULL && next != local_seen;
 }
 
 static void set_migrate(void) {
@@ -3262,6 +4228,8 @@ static void set_migrate(void) {
   /* Take a pointer to the target set for the migration. */
   struct set *next = refcounted_ptr_get(&next_global_seen);
 
+  const size_t chunks = (set_size(local_seen) + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
   for (;;) {
 
     size_t chunk = __atomic_fetch_add(&next_migration, 1, __ATOMIC_SEQ_CST);
@@ -3273,6 +4241,11 @@ static void set_migrate(void) {
       break;
     }
 
+    /* The set may be smaller than a chunk. */
+    if (end > set_size(local_seen)) {
+      end = set_size(local_seen);
+    }
+
     // TODO: The following algorithm assumes insertions can collide. That is, it
     // operates atomically on slots because another thread could be migrating
     // and also targeting the same slot. If we were to more closely wick to the
@@ -3298,27 +4271,29 @@ static void set_migrate(void) {
       }
     }
 
+    (void)__atomic_add_fetch(&migrated_chunks, 1, __ATOMIC_SEQ_CST);
   }
 
-  /* Release our reference to the old set now we're done with it. */
-  refcounted_ptr_put(&global_seen, local_seen);
-
-  /* Now we need to make sure all the threads get to this point before any one
-   * thread leaves. The purpose of this is to guarantee we only ever have at
-   * most two seen sets "in flight". Without this rendezvous, one thread could
-   * race ahead, fill the new set, and then decide to expand again while some
-   * are still working on the old set. It's possible to make such a scheme work
-   * but the synchronisation requirements just seem too complicated.
+  /* Wait for any chunks other threads are still migrating. Inserting into the
+   * new set before then could add a duplicate of a state yet to be migrated.
+   * This is a wait for at most one chunk per thread, not for other threads to
+   * arrive here, so threads busy elsewhere do not hold us up.
    */
-  rendezvous(set_update);
+  while (__atomic_load_n(&migrated_chunks, __ATOMIC_SEQ_CST) < chunks) {
+    (void)sched_yield();
+  }
 
-  /* We're now ready to resume model checking. Note that we already have a
-   * (reference counted) pointer to the now-current global seen set, so we don't
-   * need to take a fresh reference to it.
+  /* Move to the new set and release our reference to the old one. Note that we
+   * already have a (reference counted) pointer to the new set, so we don't need
+   * to take a fresh reference to it.
    */
+  struct set *old = local_seen;
   local_seen = next;
+  set_release(old);
 }
 
+static void idle_wake(int count);
+
 static void set_expand(void) {
 
   /* Using double-checked locking, we look to see if someone else has already
@@ -3329,10 +4304,15 @@ static void set_expand(void) {
    * them with migration without having the expense of acquiring the set mutex.
    */
   if (THREADS > 1 && refcounted_ptr_peek(&next_global_seen) != NULL) {
-    /* Someone else already expanded it. Join them in the migration effort. */
-    TRACE(TC_SET, "attempted expansion failed because another thread got there "
-      "first");
-    set_migrate();
+    if (set_migration_pending()) {
+      /* Someone else already expanded it. Join them in the migration effort. */
+      TRACE(TC_SET, "attempted expansion failed because another thread got "
+        "there first");
+      set_migrate();
+    }
+    /* Otherwise we have already moved to the expanded set, but some threads
+     * are yet to leave the old one, so we cannot expand again yet.
+     */
     return;
   }
 
@@ -3341,9 +4321,11 @@ static void set_expand(void) {
   /* Check again, as described above. */
   if (THREADS > 1 && refcounted_ptr_peek(&next_global_seen) != NULL) {
     set_expand_unlock();
-    TRACE(TC_SET, "attempted expansion failed because another thread got there "
-      "first");
-    set_migrate();
+    if (set_migration_pending()) {
+      TRACE(TC_SET, "attempted expansion failed because another thread got "
+        "there first");
+      set_migrate();
+    }
     return;
   }
 
@@ -3355,10 +4337,18 @@ static void set_expand(void) {
   struct set *set = xmalloc(sizeof(*set));
   set->size_exponent = local_seen->size_exponent + 1;
   set->bucket = xcalloc(set_size(set), sizeof(set->bucket[0]));
+#if LIVE_COUNTERS
+  __atomic_store_n(&telemetry_set_slots, set_size(set), __ATOMIC_RELAXED);
+  __atomic_store_n(&telemetry_set_expansions, telemetry_set_expansions + 1,
+    __ATOMIC_RELAXED);
+#endif
 
   /* Advertise this as the newly expanded global set. */
   refcounted_ptr_set(&next_global_seen, set);
 
+  /* Parked threads need to help with the migration. */
+  idle_wake(INT_MAX);
+
   /* We now need to migrate all slots from the old set to the new one, but we
    * can do this multithreaded.
    */
@@ -3366,7 +4356,12 @@ static void set_expand(void) {
   set_migrate();
 }
 
-static bool set_insert(struct state *NONNULL s, size_t *NONNULL count) {
+/* Insert a state into the seen set, returning true if it was not already
+ * present. If it was, and `duplicate` is non-NULL, the existing copy is
+ * returned through it.
+ */
+static bool set_insert(struct state *NONNULL s, size_t *NONNULL count,
+    const struct state **duplicate) {
 
 restart:;
 
@@ -3412,8 +4407,8 @@ restart:;
     }
 
     if (slot_is_tombstone(c)) {
-      /* This slot has been migrated. We need to rendezvous with other migrating
-       * threads and restart our insertion attempt on the newly expanded set.
+      /* This slot has been migrated. We need to help with the migration and
+       * restart our insertion attempt on the newly expanded set.
        */
       set_migrate();
       goto restart;
@@ -3422,6 +4417,9 @@ restart:;
     /* If we find this already in the set, we're done. */
     if (state_eq(s, slot_to_state(c))) {
       TRACE(TC_SET, "skipped adding state %p that was already in set", s);
+      if (duplicate != NULL) {
+        *duplicate = slot_to_state(c);
+      }
       return false;
     }
 
@@ -3429,11 +4427,19 @@ restart:;
   }
 
   /* If we reach here, the set is full. Expand it and retry the insertion. */
+  const struct set *full = local_seen;
   set_expand();
-  return set_insert(s, count);
+  if (local_seen == full && refcounted_ptr_peek(&next_global_seen) == full) {
+    /* We could not expand it because the last expansion is still waiting on
+     * other threads to leave the old set. Give them a chance to run.
+     */
+    (void)sched_yield();
+  }
+  goto restart;
 }
 
-/* Find an existing element in the set.
+/* Find the index of an existing element in the set, or SIZE_MAX if it is not
+ * present.
  *
  * Why would you ever want to do this? If you already have the state, why do you
  * want to find a copy of it? The answer is for liveness information. When
@@ -3441,7 +4447,7 @@ restart:;
  * already contained in the state set might know some of the liveness properties
  * are satisfied that your current state considers unknown.
  */
-static __attribute__((unused)) const struct state *set_find(
+static __attribute__((unused)) size_t set_find_index(
     const struct state *NONNULL s) {
 
   assert(s != NULL);
@@ -3470,201 +4476,1468 @@ static __attribute__((unused)) const struct state *set_find(
 
     if (state_eq(s, n)) {
       /* found */
-      return n;
+      return i;
     }
 
     attempts++;
   }
 
   /* not found */
-  return NULL;
+  return SIZE_MAX;
 }
 
-/******************************************************************************/
+/*******************************************************************************
+ * Waiting for work                                                            *
+ *                                                                             *
+ * A thread that finds every queue empty cannot assume exploration is over,    *
+ * because other threads may still be expanding states. To tell when it is,    *
+ * each thread counts the states it has queued and the states it has finished  *
+ * expanding, on its own cache line so the counts are cheap to maintain.       *
+ * Exploration is over when the totals are equal. A state is counted as queued *
+ * before it becomes visible in a queue, so summing every thread's finished    *
+ * count before any queued count can only see them equal if, at some instant,  *
+ * every queued state had been fully expanded. Thread 0 starts with a state    *
+ * "queued" that stands for init() generating the start states.                *
+ *                                                                             *
+ * Until then, idle threads park on a futex and are woken when there may be    *
+ * new work, a seen set migration to help with, or a reason to exit.           *
+ ******************************************************************************/
 
-static time_t START_TIME;
+struct work_count {
+  size_t enqueued;
+  size_t finished;
+} __attribute__((aligned(64)));
 
-static unsigned long long gettime() {
-  return (unsigned long long)(time(NULL) - START_TIME);
+static struct work_count work_counts[THREADS] = { [0] = { .enqueued = 1 } };
+
+/* futex word, changed whenever parked threads should look for work again */
+static uint32_t idle_epoch;
+
+/* number of threads parked, or about to park, on `idle_epoch` */
+static size_t idle_parked;
+
+static void work_count_add(size_t *NONNULL count) {
+  __atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1,
+    __ATOMIC_SEQ_CST);
 }
 
-#if LIVENESS_COUNT > 0
-/* Set one of the liveness bits (i.e. mark the matching property as 'hit') in a
- * state and all its predecessors.
- */
-static __attribute__((unused)) void mark_liveness(struct state *NONNULL s,
-    size_t index, bool shared) {
+/* Note that a state is about to be added to a queue. */
+static void work_enqueued(void) {
+  if (THREADS > 1) {
+    work_count_add(&work_counts[thread_id].enqueued);
+  }
+}
 
-  assert(s != NULL);
-  ASSERT(index < sizeof(s->liveness) * CHAR_BIT
-    && "out of range liveness write");
+/* Note that init() or the expansion of a state is complete. */
+static void work_finished(void) {
+  if (THREADS > 1) {
+    work_count_add(&work_counts[thread_id].finished);
+  }
+}
 
-  size_t word_index = index / (sizeof(s->liveness[0]) * CHAR_BIT);
-  size_t bit_index = index % (sizeof(s->liveness[0]) * CHAR_BIT);
+static bool work_done(void) {
 
-  uintptr_t previous_value;
-  uintptr_t *target = &s->liveness[word_index];
-  uintptr_t mask = ((uintptr_t)1) << bit_index;
+  size_t finished = 0;
+  for (size_t i = 0; i < sizeof(work_counts) / sizeof(work_counts[0]); i++) {
+    finished += __atomic_load_n(&work_counts[i].finished, __ATOMIC_SEQ_CST);
+  }
 
-  if (shared) {
-    /* If this state is shared (accessible by other threads) we need to operate
-     * on its liveness data atomically.
-     */
-    previous_value = __atomic_fetch_or(target, mask, __ATOMIC_SEQ_CST);
-  } else {
-    /* Otherwise we can use a cheaper ordinary OR. */
-    previous_value = *target;
-    *target |= mask;
+  size_t enqueued = 0;
+  for (size_t i = 0; i < sizeof(work_counts) / sizeof(work_counts[0]); i++) {
+    enqueued += __atomic_load_n(&work_counts[i].enqueued, __ATOMIC_SEQ_CST);
   }
 
-  /* Cheat a little and cast away the constness of the previous state for which
-   * we may need to update liveness data.
-   */
-  struct state *previous = state_drop_const(state_previous_get(s));
-
-  /* If the given bit was already set, we know all the predecessors of this
-   * state have already had their corresponding bit marked. However, if it was
-   * not we now need to recurse to mark them. Note that we assume any
-   * predecessors of this state are globally visible and hence shared. The
-   * recursion depth here can be indeterminately deep, but we assume the
-   * compiler can tail-optimise this call.
-   */
-  if ((previous_value & mask) != mask && previous != NULL) {
-    mark_liveness(previous, index, true);
+  assert(finished <= enqueued && "more states expanded than were queued");
+  return finished == enqueued;
+}
+
+/* Wake up to `count` parked threads. */
+static void idle_wake(int count) {
+
+  if (THREADS == 1 || __atomic_load_n(&idle_parked, __ATOMIC_SEQ_CST) == 0) {
+    return;
   }
+
+  (void)__atomic_add_fetch(&idle_epoch, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+  (void)syscall(SYS_futex, &idle_epoch, FUTEX_WAKE_PRIVATE, count, NULL, NULL,
+    0);
+#else
+  (void)count;
+#endif
 }
 
-/* number of unknown liveness properties for a given state */
-static unsigned long unknown_liveness(const struct state *NONNULL s) {
+/* Whether a parked thread has something to do. */
+static bool idle_interrupted(void) {
 
-  assert(s != NULL);
+  for (size_t i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+    if (__atomic_load_n(&q[i].count, __ATOMIC_SEQ_CST) > 0) {
+      return true;
+    }
+  }
 
-  unsigned long unknown = 0;
+  return set_migration_pending()
+    || __atomic_load_n(&error_count, __ATOMIC_SEQ_CST) >= MAX_ERRORS
+    || work_done();
+}
 
-  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
+static void idle_park(void) {
 
-    uintptr_t word = __atomic_load_n(&s->liveness[i], __ATOMIC_SEQ_CST);
+  uint32_t epoch = __atomic_load_n(&idle_epoch, __ATOMIC_SEQ_CST);
+  (void)__atomic_add_fetch(&idle_parked, 1, __ATOMIC_SEQ_CST);
 
-    for (size_t j = 0; j < sizeof(s->liveness[0]) * CHAR_BIT; j++) {
-      if (i * sizeof(s->liveness[0]) * CHAR_BIT + j >= LIVENESS_COUNT) {
-        break;
-      }
+  /* Check again now any waker will see us, to avoid sleeping through an event
+   * that happened before we incremented `idle_parked`.
+   */
+  if (!idle_interrupted()) {
+#ifdef __linux__
+    /* This returns immediately if `idle_epoch` has already moved on. */
+    (void)syscall(SYS_futex, &idle_epoch, FUTEX_WAIT_PRIVATE, epoch, NULL,
+      NULL, 0);
+#else
+    (void)epoch;
+    (void)sched_yield();
+#endif
+  }
 
-      if (!((word >> j) & 0x1)) {
-        unknown++;
-      }
+  (void)__atomic_sub_fetch(&idle_parked, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Get the next state to expand. Returns NULL when there is nothing left to
+ * explore or another thread has found enough errors that we should stop.
+ */
+static const struct state *queue_next(size_t *NONNULL queue_id) {
+
+  for (;;) {
+
+    const struct state *s = queue_dequeue(queue_id);
+    if (THREADS == 1 || s != NULL) {
+      return s;
     }
-  }
 
-  return unknown;
+    if (work_done()) {
+      /* let other parked threads see this too */
+      idle_wake(INT_MAX);
+      return NULL;
+    }
+
+    if (__atomic_load_n(&error_count, __ATOMIC_SEQ_CST) >= MAX_ERRORS) {
+      return NULL;
+    }
+
+    /* A seen set cannot be expanded again until every thread has moved off
+     * the old one, so help with and move to any expansion in progress.
+     */
+    if (set_migration_pending()) {
+      set_migrate();
+      continue;
+    }
+
+    idle_park();
+  }
 }
 
-/* Learn new liveness information about the state `s` from its successor. Note
- * that typically `state_previous_get(successor) != s` because `successor` is
- * actually one of the de-duped aliases of the original successor to `s`.
- *
- * @param s State to learn information about
- * @param successor Successor to s
- * @return Number of new liveness information facts learnt
+#if EDGE_LOG
+/*******************************************************************************
+ * Edge log                                                                    *
+ *                                                                             *
+ * With --edge-log, each thread appends every transition it explores to its    *
+ * own log, so later analyses can find a state's successors without firing     *
+ * rules again. A record is a source state, a target state and the rule taken, *
+ * each as a LEB128-style variable length integer. States are stored as        *
+ * distances in units of their alignment: the source relative to the previous  *
+ * record's source (usually zero, as a state's successors are logged           *
+ * together) and the target relative to the source.                            *
+ ******************************************************************************/
+
+struct edge_log {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  uintptr_t last_source; /* source of the most recently appended record */
+};
+
+/* As with rules_fired, each thread appends to its own log and publishes it to
+ * the global array on exit.
  */
-static unsigned long learn_liveness(struct state *NONNULL s,
-    const struct state *NONNULL successor) {
+static _Thread_local struct edge_log edge_log_local;
+static struct edge_log edge_logs[THREADS];
 
-  assert(s != NULL);
-  assert(successor != NULL);
+static uint64_t edge_log_zigzag(intptr_t v) {
+  return v < 0 ? ((uint64_t)~(uintptr_t)v << 1) | 1 : (uint64_t)v << 1;
+}
 
-  unsigned long new_info = 0;
+static intptr_t edge_log_unzigzag(uint64_t v) {
+  return (v & 1) ? (intptr_t)~(uintptr_t)(v >> 1) : (intptr_t)(v >> 1);
+}
 
-  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
+static void edge_log_put(struct edge_log *NONNULL log, uint64_t v) {
 
-    uintptr_t word_src = __atomic_load_n(&successor->liveness[i],
-      __ATOMIC_SEQ_CST);
-    uintptr_t word_dst = __atomic_load_n(&s->liveness[i], __ATOMIC_SEQ_CST);
+  /* a 64-bit value needs at most 10 bytes */
+  if (log->capacity - log->size < 10) {
+    log->capacity = log->capacity == 0 ? 4096 : log->capacity * 2;
+    log->data = xrealloc(log->data, log->capacity);
+  }
 
-    for (size_t j = 0; j < sizeof(s->liveness[0]) * CHAR_BIT; j++) {
-      if (i * sizeof(s->liveness[0]) * CHAR_BIT + j >= LIVENESS_COUNT) {
-        break;
-      }
+  while (v >= 0x80) {
+    log->data[log->size++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  log->data[log->size++] = (uint8_t)v;
+}
 
-      bool live_src = !!((word_src >> j) & 0x1);
-      bool live_dst = !!((word_dst >> j) & 0x1);
+static uint64_t edge_log_get(const struct edge_log *NONNULL log,
+    size_t *NONNULL offset) {
 
-      if (!live_dst && live_src) {
-        mark_liveness(s, i * sizeof(s->liveness[0]) * CHAR_BIT + j, true);
-        new_info++;
-      }
+  uint64_t v = 0;
+  for (unsigned shift = 0; ; shift += 7) {
+    ASSERT(*offset < log->size && "truncated edge log record");
+    uint8_t byte = log->data[(*offset)++];
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return v;
     }
   }
+}
 
-  return new_info;
+static __attribute__((unused)) void edge_log_append(
+    const struct state *NONNULL source, const struct state *NONNULL target,
+    uint64_t rule_taken) {
+
+  enum { ALIGN = _Alignof(struct state) };
+
+  const uintptr_t s = (uintptr_t)source / ALIGN;
+  const uintptr_t t = (uintptr_t)target / ALIGN;
+
+  edge_log_put(&edge_log_local,
+    edge_log_zigzag((intptr_t)(s - edge_log_local.last_source)));
+  edge_log_put(&edge_log_local, edge_log_zigzag((intptr_t)(t - s)));
+  edge_log_put(&edge_log_local, rule_taken);
+
+  edge_log_local.last_source = s;
 }
-#endif
 
-/* Prototypes for generated functions. */
-static void init(void);
-static _Noreturn void explore(void);
-#if LIVENESS_COUNT > 0
-static void check_liveness_final(void);
-static unsigned long check_liveness_summarise(void);
+/* Read the record at `*offset` from a log, advancing past it. `*last_source`
+ * must be zero for the first record and is subsequently maintained by this
+ * function.
+ */
+static __attribute__((unused)) void edge_log_read(
+    const struct edge_log *NONNULL log, size_t *NONNULL offset,
+    uintptr_t *NONNULL last_source, const struct state **NONNULL source,
+    const struct state **NONNULL target, uint64_t *NONNULL rule_taken) {
+
+  enum { ALIGN = _Alignof(struct state) };
+
+  const uintptr_t s = *last_source
+    + (uintptr_t)edge_log_unzigzag(edge_log_get(log, offset));
+  const uintptr_t t = s + (uintptr_t)edge_log_unzigzag(edge_log_get(log, offset));
+  *rule_taken = edge_log_get(log, offset);
+
+  *last_source = s;
+  *source = (const struct state*)(s * ALIGN);
+  *target = (const struct state*)(t * ALIGN);
+}
 #endif
 
-static int exit_with(int status) {
+/******************************************************************************/
 
-  /* Opt out of the thread-wide rendezvous protocol. */
-  refcounted_ptr_put(&global_seen, local_seen);
-  rendezvous_opt_out(set_update);
-  local_seen = NULL;
+static time_t START_TIME;
 
-  /* Make fired rule count visible globally. */
-  rules_fired[thread_id] = rules_fired_local;
+static unsigned long long gettime() {
+  return (unsigned long long)(time(NULL) - START_TIME);
+}
 
-  if (thread_id == 0) {
-    /* We are the initial thread. Wait on the others before exiting. */
-#ifdef __clang__
-  #pragma clang diagnostic push
-  #pragma clang diagnostic ignored "-Wtautological-compare"
-  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
-#elif defined(__GNUC__)
-  #pragma GCC diagnostic push
-  #pragma GCC diagnostic ignored "-Wtype-limits"
-#endif
-    for (size_t i = 0; phase == RUN &&
-         i < sizeof(threads) / sizeof(threads[0]); i++) {
-#ifdef __clang__
-  #pragma clang diagnostic pop
-#elif defined(__GNUC__)
-  #pragma GCC diagnostic pop
-#endif
-      void *ret;
-      int r = pthread_join(threads[i], &ret);
-      if (__builtin_expect(r != 0, 0)) {
-        flockfile(stdout);
-        fprintf(stderr, "failed to join thread: %s\n", strerror(r));
-        funlockfile(stdout);
-        continue;
-      }
-      status |= (int)(intptr_t)ret;
-    }
+#if TELEMETRY_FD >= 0
+/*******************************************************************************
+ * Telemetry                                                                   *
+ *                                                                             *
+ * With --telemetry, a dedicated thread periodically samples the checking      *
+ * threads' counters and writes a record of them to a file descriptor, one per *
+ * line, as JSON or, in machine-readable mode, as XML.                         *
+ ******************************************************************************/
 
-    /* We're now single-threaded again. */
+/* monotonic time in seconds */
+static double telemetry_now(void) {
+  struct timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
 
-    /* Reacquire a pointer to the seen set. Note that this may not be the same
-     * value as what we previously had in local_seen because the other threads
-     * may have expanded and migrated the seen set in the meantime.
-     */
-    local_seen = refcounted_ptr_get(&global_seen);
+static double telemetry_start;
 
-    if (error_count == 0) {
-      /* If we didn't see any other errors, print cover information. */
-#ifdef __clang__
-  #pragma clang diagnostic push
-  #pragma clang diagnostic ignored "-Wtautological-compare"
-  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
-#elif defined(__GNUC__)
-  #pragma GCC diagnostic push
-  #pragma GCC diagnostic ignored "-Wtype-limits"
-#endif
-      for (size_t i = 0; i < sizeof(covers) / sizeof(covers[0]); i++) {
+/* Serialises sampling between the telemetry thread and the final sample. */
+static pthread_mutex_t telemetry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void telemetry_sample(bool final) {
+
+  /* totals as of the previous sample, for computing rates */
+  static double last_time;
+  static uint64_t last_states;
+  static uint64_t last_rules_fired;
+
+  /* enough room for a record with counters of every thread */
+  static char buffer[512 + THREADS * 160];
+
+  int r __attribute__((unused)) = pthread_mutex_lock(&telemetry_lock);
+  assert(r == 0);
+
+  const double now = telemetry_now() - telemetry_start;
+  const uint64_t states = __atomic_load_n(&seen_count, __ATOMIC_RELAXED);
+  const size_t slots = __atomic_load_n(&telemetry_set_slots, __ATOMIC_RELAXED);
+  uint64_t rules_fired = 0;
+  uint64_t arena_bytes = 0;
+  for (size_t i = 0; i < THREADS; i++) {
+    rules_fired += __atomic_load_n(&telemetry[i].rules_fired, __ATOMIC_RELAXED);
+    arena_bytes += __atomic_load_n(&telemetry[i].arena_bytes, __ATOMIC_RELAXED);
+  }
+
+  const double elapsed = now - last_time;
+  const double states_per_second =
+    elapsed > 0 ? (double)(states - last_states) / elapsed : 0;
+  const double rules_per_second =
+    elapsed > 0 ? (double)(rules_fired - last_rules_fired) / elapsed : 0;
+  last_time = now;
+  last_states = states;
+  last_rules_fired = rules_fired;
+
+  size_t len = 0;
+#define APPEND(...) \
+  do { \
+    if (len < sizeof(buffer)) { \
+      len += (size_t)snprintf(buffer + len, sizeof(buffer) - len, __VA_ARGS__); \
+    } \
+  } while (0)
+
+  APPEND(MACHINE_READABLE_OUTPUT
+    ? "<telemetry time=\"%.3f\" states=\"%" PRIu64 "\" "
+      "states_per_second=\"%.1f\" rules_fired=\"%" PRIu64 "\" "
+      "rules_per_second=\"%.1f\" set_slots=\"%zu\" load_factor=\"%.3f\" "
+      "set_expansions=\"%" PRIu64 "\" arena_bytes=\"%" PRIu64 "\" "
+      "final=\"%s\">"
+    : "{\"time\":%.3f,\"states\":%" PRIu64 ",\"states_per_second\":%.1f,"
+      "\"rules_fired\":%" PRIu64 ",\"rules_per_second\":%.1f,"
+      "\"set_slots\":%zu,\"load_factor\":%.3f,\"set_expansions\":%" PRIu64
+      ",\"arena_bytes\":%" PRIu64 ",\"final\":%s,\"threads\":[",
+    now, states, states_per_second, rules_fired, rules_per_second, slots,
+    slots > 0 ? (double)states / (double)slots : 0,
+    __atomic_load_n(&telemetry_set_expansions, __ATOMIC_RELAXED), arena_bytes,
+    final ? "true" : "false");
+
+  for (size_t i = 0; i < THREADS; i++) {
+    APPEND(MACHINE_READABLE_OUTPUT
+      ? "%s<thread id=\"%zu\" states=\"%" PRIu64 "\" rules_fired=\"%" PRIu64
+        "\" queue_size=\"%zu\" arena_bytes=\"%" PRIu64 "\"/>"
+      : "%s{\"id\":%zu,\"states\":%" PRIu64 ",\"rules_fired\":%" PRIu64
+        ",\"queue_size\":%zu,\"arena_bytes\":%" PRIu64 "}",
+      i == 0 || MACHINE_READABLE_OUTPUT ? "" : ",", i,
+      __atomic_load_n(&telemetry[i].states, __ATOMIC_RELAXED),
+      __atomic_load_n(&telemetry[i].rules_fired, __ATOMIC_RELAXED),
+      __atomic_load_n(&q[i].count, __ATOMIC_RELAXED),
+      __atomic_load_n(&telemetry[i].arena_bytes, __ATOMIC_RELAXED));
+  }
+
+  APPEND(MACHINE_READABLE_OUTPUT ? "</telemetry>\n" : "]}\n");
+#undef APPEND
+
+  if (len > sizeof(buffer) - 1) {
+    len = sizeof(buffer) - 1;
+  }
+
+  /* Records are short enough to usually go out in a single write, keeping them
+   * intact if the descriptor is a pipe shared with other writers.
+   */
+  for (size_t written = 0; written < len; ) {
+    ssize_t w = write(TELEMETRY_FD, buffer + written, len - written);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      /* nothing sensible to do if the consumer has gone away */
+      break;
+    }
+    written += (size_t)w;
+  }
+
+  r = pthread_mutex_unlock(&telemetry_lock);
+  assert(r == 0);
+}
+
+static void *telemetry_main(void *arg __attribute__((unused))) {
+  for (;;) {
+    struct timespec interval = {
+      .tv_sec = TELEMETRY_INTERVAL / 1000,
+      .tv_nsec = (long)(TELEMETRY_INTERVAL % 1000) * 1000000,
+    };
+    while (nanosleep(&interval, &interval) != 0 && errno == EINTR);
+    telemetry_sample(false);
+  }
+  return NULL;
+}
+
+static void start_telemetry(void) {
+  telemetry_start = telemetry_now();
+
+  pthread_t thread;
+  int r = pthread_create(&thread, NULL, telemetry_main, NULL);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "failed to create telemetry thread: %s\n", strerror(r));
+    return;
+  }
+  (void)pthread_detach(thread);
+}
+#endif
+
+#if METRICS_SOCKET
+/*******************************************************************************
+ * Metrics endpoint                                                            *
+ *                                                                             *
+ * With --metrics-socket, a dedicated thread serves the checker's counters in  *
+ * the Prometheus text exposition format to each client that connects to a    *
+ * Unix domain socket. Clients that send an HTTP request get an HTTP response, *
+ * so the socket can be scraped directly by a Prometheus server.               *
+ ******************************************************************************/
+
+enum {
+  /* how long to wait for a client to send a request */
+  METRICS_REQUEST_TIMEOUT_MS = 100,
+
+  /* how long to pause when we cannot accept connections */
+  METRICS_BACKOFF_MS = 100,
+};
+
+static void metrics_listen(void) {
+
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(METRICS_SOCKET_PATH) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "metrics socket path %s is too long\n",
+      METRICS_SOCKET_PATH);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(addr.sun_path, METRICS_SOCKET_PATH);
+
+  /* remove a stale socket left behind by a previous run */
+  struct stat st;
+  if (lstat(METRICS_SOCKET_PATH, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    (void)unlink(METRICS_SOCKET_PATH);
+  }
+
+  metrics_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (__builtin_expect(metrics_fd < 0, 0)) {
+    perror("failed to create metrics socket");
+    exit(EXIT_FAILURE);
+  }
+
+  if (__builtin_expect(bind(metrics_fd, (const struct sockaddr*)&addr,
+      sizeof(addr)) != 0, 0)) {
+    fprintf(stderr, "failed to bind metrics socket %s: %s\n",
+      METRICS_SOCKET_PATH, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  if (__builtin_expect(listen(metrics_fd, 8) != 0, 0)) {
+    perror("failed to listen on metrics socket");
+    exit(EXIT_FAILURE);
+  }
+
+  /* A client that disconnects before reading its reply would otherwise kill us
+   * with SIGPIPE when we write it.
+   */
+  if (__builtin_expect(signal(SIGPIPE, SIG_IGN) == SIG_ERR, 0)) {
+    perror("failed to ignore SIGPIPE");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* Write the current metrics into a buffer, returning their length. */
+static size_t metrics_format(char *NONNULL buffer, size_t size) {
+
+  size_t len = 0;
+#define APPEND(...) \
+  do { \
+    if (len < size) { \
+      len += (size_t)snprintf(buffer + len, size - len, __VA_ARGS__); \
+    } \
+  } while (0)
+
+  APPEND("# HELP rumur_states Distinct states seen.\n"
+         "# TYPE rumur_states gauge\n"
+         "rumur_states %zu\n",
+         __atomic_load_n(&seen_count, __ATOMIC_RELAXED));
+
+  APPEND("# HELP rumur_rules_fired_total Rules fired.\n"
+         "# TYPE rumur_rules_fired_total counter\n");
+  for (size_t i = 0; i < THREADS; i++) {
+    APPEND("rumur_rules_fired_total{thread=\"%zu\"} %" PRIu64 "\n", i,
+      __atomic_load_n(&telemetry[i].rules_fired, __ATOMIC_RELAXED));
+  }
+
+  APPEND("# HELP rumur_queue_size States waiting to be expanded.\n"
+         "# TYPE rumur_queue_size gauge\n");
+  for (size_t i = 0; i < THREADS; i++) {
+    APPEND("rumur_queue_size{thread=\"%zu\"} %zu\n", i,
+      __atomic_load_n(&q[i].count, __ATOMIC_RELAXED));
+  }
+
+  APPEND("# HELP rumur_set_slots Capacity of the seen set.\n"
+         "# TYPE rumur_set_slots gauge\n"
+         "rumur_set_slots %zu\n"
+         "# HELP rumur_set_expansions_total Expansions of the seen set.\n"
+         "# TYPE rumur_set_expansions_total counter\n"
+         "rumur_set_expansions_total %" PRIu64 "\n",
+         __atomic_load_n(&telemetry_set_slots, __ATOMIC_RELAXED),
+         __atomic_load_n(&telemetry_set_expansions, __ATOMIC_RELAXED));
+
+  APPEND("# HELP rumur_errors Errors found.\n"
+         "# TYPE rumur_errors gauge\n"
+         "rumur_errors %lu\n",
+         __atomic_load_n(&error_count, __ATOMIC_RELAXED));
+
+  /* ru_maxrss is in kilobytes on Linux and the BSDs, but bytes on macOS */
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+    const uintmax_t rss = (uintmax_t)usage.ru_maxrss;
+#else
+    const uintmax_t rss = (uintmax_t)usage.ru_maxrss * 1024;
+#endif
+    APPEND("# HELP rumur_max_rss_bytes Peak resident set size.\n"
+           "# TYPE rumur_max_rss_bytes gauge\n"
+           "rumur_max_rss_bytes %" PRIuMAX "\n", rss);
+  }
+
+#undef APPEND
+
+  return len < size ? len : size - 1;
+}
+
+static void *metrics_main(void *arg __attribute__((unused))) {
+
+  /* enough room for the metrics of every thread */
+  static char body[1024 + THREADS * 128];
+  static char request[1024];
+
+  for (;;) {
+    int fd = accept(metrics_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      /* Out of descriptors or memory. Back off instead of spinning, in the
+       * hope the condition passes.
+       */
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM) {
+        (void)poll(NULL, 0, METRICS_BACKOFF_MS);
+        continue;
+      }
+      /* anything else will not be fixed by retrying */
+      perror("failed to accept on metrics socket");
+      return NULL;
+    }
+
+    /* Scrapers send a request before reading, while simpler clients may send
+     * nothing at all, so we only look at what arrives in the first read. Wait
+     * only briefly for it, so a client that sends nothing and keeps its
+     * connection open does not block everyone else.
+     */
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    ssize_t r = -1;
+    if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT_MS) > 0) {
+      r = read(fd, request, sizeof(request) - 1);
+    }
+    const bool http = r >= 4 && strncmp(request, "GET ", 4) == 0;
+
+    size_t len = metrics_format(body, sizeof(body));
+
+    char header[128] = { 0 };
+    if (http) {
+      snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\n"
+        "\r\n", len);
+    }
+
+    const char *parts[] = { header, body };
+    const size_t lengths[] = { strlen(header), len };
+    for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+      for (size_t written = 0; written < lengths[i]; ) {
+        ssize_t w = write(fd, parts[i] + written, lengths[i] - written);
+        if (w < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          /* the client went away */
+          break;
+        }
+        written += (size_t)w;
+      }
+    }
+
+    (void)close(fd);
+  }
+
+  return NULL;
+}
+
+static void start_metrics(void) {
+  pthread_t thread;
+  int r = pthread_create(&thread, NULL, metrics_main, NULL);
+  if (__builtin_expect(r != 0, 0)) {
+    fprintf(stderr, "failed to create metrics thread: %s\n", strerror(r));
+    return;
+  }
+  (void)pthread_detach(thread);
+}
+#endif
+
+#if LIVENESS_COUNT > 0
+/* Set liveness bits (i.e. mark the matching properties as 'hit') in one word of
+ * a state's liveness data and in all its predecessors.
+ */
+static __attribute__((unused)) void mark_liveness(struct state *NONNULL s,
+    size_t word_index, uintptr_t mask, bool shared) {
+
+  assert(s != NULL);
+  ASSERT(word_index < sizeof(s->liveness) / sizeof(s->liveness[0])
+    && "out of range liveness write");
+
+  /* Walk back through predecessors, stopping once none of the bits we are
+   * setting are new. If a bit was already set in a state, all the predecessors
+   * of that state have had it set, or are having it set by whichever thread set
+   * it first. As each bit is set by a single atomic operation, ordering beyond
+   * this is not needed and we can use relaxed atomics.
+   */
+  for (;;) {
+
+    uintptr_t *target = &s->liveness[word_index];
+    uintptr_t previous_value;
+
+    if (shared) {
+      /* If this state is shared (accessible by other threads) we need to
+       * operate on its liveness data atomically.
+       */
+      previous_value = __atomic_fetch_or(target, mask, __ATOMIC_RELAXED);
+    } else {
+      /* Otherwise we can use a cheaper ordinary OR. */
+      previous_value = *target;
+      *target |= mask;
+    }
+
+    /* only bits that were not already set need to be passed back */
+    mask &= ~previous_value;
+    if (mask == 0) {
+      break;
+    }
+
+    /* Cheat a little and cast away the constness of the previous state for
+     * which we may need to update liveness data. Note that we assume any
+     * predecessors of this state are globally visible and hence shared.
+     */
+    s = state_drop_const(state_previous_get(s));
+    if (s == NULL) {
+      break;
+    }
+    shared = true;
+  }
+}
+
+/* number of unknown liveness properties for a given state */
+static unsigned long unknown_liveness(const struct state *NONNULL s) {
+
+  assert(s != NULL);
+
+  unsigned long unknown = 0;
+
+  for (size_t i = 0; i < sizeof(s->liveness) / sizeof(s->liveness[0]); i++) {
+
+    uintptr_t word = __atomic_load_n(&s->liveness[i], __ATOMIC_RELAXED);
+
+    for (size_t j = 0; j < sizeof(s->liveness[0]) * CHAR_BIT; j++) {
+      if (i * sizeof(s->liveness[0]) * CHAR_BIT + j >= LIVENESS_COUNT) {
+        break;
+      }
+
+      if (!((word >> j) & 0x1)) {
+        unknown++;
+      }
+    }
+  }
+
+  return unknown;
+}
+
+/* An edge in the state graph, recorded during the final liveness check. States
+ * are identified by their index in the seen set, which is stable by this point.
+ */
+struct liveness_edge {
+  size_t successor;
+  size_t state;
+};
+
+/* A growable list of edges, collected by a single thread. */
+struct liveness_edges {
+  struct liveness_edge *edges;
+  size_t count;
+  size_t capacity;
+
+  /* Whether to also retain the successor states themselves. These are only
+   * needed when constructing a counterexample.
+   */
+  bool keep_successors;
+  struct state **successors;
+};
+
+/* Record an edge, returning true if the successor state `n` was retained. */
+static __attribute__((unused)) bool liveness_edges_append(
+    struct liveness_edges *NONNULL e, size_t successor, size_t state,
+    struct state *n) {
+
+  if (e->count == e->capacity) {
+    e->capacity = e->capacity == 0 ? 1024 : e->capacity * 2;
+    e->edges = xrealloc(e->edges, e->capacity * sizeof(e->edges[0]));
+    if (e->keep_successors) {
+      e->successors = xrealloc(e->successors,
+        e->capacity * sizeof(e->successors[0]));
+    }
+  }
+
+  e->edges[e->count].successor = successor;
+  e->edges[e->count].state = state;
+  if (e->keep_successors) {
+    e->successors[e->count] = n;
+  }
+  e->count++;
+
+  return e->keep_successors;
+}
+#endif
+
+/* Prototypes for generated functions. */
+static void init(void);
+static _Noreturn void explore(void);
+#if LIVENESS_COUNT > 0
+static void liveness_expand(const struct state *NONNULL s, size_t index,
+  struct liveness_edges *NONNULL edges);
+static unsigned long check_liveness_summarise(void);
+#endif
+
+#if LIVENESS_COUNT > 0
+/*******************************************************************************
+ * Final liveness check                                                        *
+ *                                                                             *
+ * During exploration, liveness bits are passed back along predecessor         *
+ * pointers. This misses edges to successors that were de-duped against states *
+ * already in the seen set. To account for these, we expand every state whose  *
+ * liveness is not fully known, recording its edges, and then pass liveness    *
+ * bits backwards along these from a work list until nothing new is learned.   *
+ * Both steps are split among THREADS threads.                                 *
+ ******************************************************************************/
+
+/* a thread's share of the final liveness check */
+struct liveness_worker {
+  size_t id;       /* thread identifier to run as */
+  struct set *set; /* the seen set */
+
+  /* range of seen set slots (first step) or edges (second step) to process */
+  size_t begin;
+  size_t end;
+
+  struct liveness_edges edges; /* edges found in the first step */
+
+  /* all edges, sorted by successor, for the second step */
+  const struct liveness_edge *all;
+  size_t all_count;
+
+  unsigned long learned; /* liveness facts learned in the second step */
+};
+
+/* first step: expand states, recording edges */
+static void liveness_collect(struct liveness_worker *NONNULL w) {
+
+#if EDGE_LOG
+  /* Read the edges this thread logged during exploration, rather than firing
+   * rules again.
+   */
+  const struct edge_log *log = &edge_logs[w->id];
+  size_t offset = 0;
+  uintptr_t last_source = 0;
+  const struct state *previous = NULL;
+  size_t previous_index = SIZE_MAX;
+  while (offset < log->size) {
+
+    const struct state *source;
+    const struct state *target;
+    uint64_t rule_taken;
+    edge_log_read(log, &offset, &last_source, &source, &target, &rule_taken);
+
+    if (unknown_liveness(source) == 0) {
+      /* skip entries where liveness is fully satisfied already */
+      continue;
+    }
+
+    /* a state's successors are logged together, so avoid repeated lookups of
+     * the same source
+     */
+    if (source != previous) {
+      previous = source;
+      previous_index = set_find_index(source);
+      ASSERT(previous_index != SIZE_MAX && "logged state not in seen set");
+    }
+
+    size_t successor = set_find_index(target);
+    ASSERT(successor != SIZE_MAX && "logged state not in seen set");
+
+    (void)liveness_edges_append(&w->edges, successor, previous_index, NULL);
+  }
+#else
+  for (size_t i = w->begin; i < w->end; i++) {
+
+    slot_t slot = __atomic_load_n(&w->set->bucket[i], __ATOMIC_RELAXED);
+
+    ASSERT(!slot_is_tombstone(slot)
+      && "seen set being migrated during final liveness check");
+
+    if (slot_is_empty(slot)) {
+      /* skip empty entries in the hash table */
+      continue;
+    }
+
+    struct state *s = slot_to_state(slot);
+    ASSERT(s != NULL && "null pointer stored in state set");
+
+    if (unknown_liveness(s) == 0) {
+      /* skip entries where liveness is fully satisfied already */
+      continue;
+    }
+
+#if BOUND > 0
+    /* If we're doing bounded checking and this state is at the bound limit,
+     * it's not valid to expand beyond this.
+     */
+    ASSERT(state_bound_get(s) <= BOUND && "a state that exceeded the bound depth was explored");
+    if (state_bound_get(s) == BOUND) {
+      continue;
+    }
+#endif
+
+    liveness_expand(s, i, &w->edges);
+  }
+#endif
+}
+
+static int liveness_edge_compare(const void *a, const void *b) {
+  const struct liveness_edge *x = a;
+  const struct liveness_edge *y = b;
+  if (x->successor < y->successor) {
+    return -1;
+  }
+  if (x->successor > y->successor) {
+    return 1;
+  }
+  return 0;
+}
+
+/* second step: pass liveness bits from successors back to their predecessors */
+static void liveness_propagate(struct liveness_worker *NONNULL w) {
+
+  enum { WORDS = sizeof(((struct state*)0)->liveness) /
+    sizeof(((struct state*)0)->liveness[0]) };
+
+  /* work list of states whose liveness bits may need passing back */
+  size_t *pending = NULL;
+  size_t pending_count = 0;
+  size_t pending_capacity = 0;
+#define PUSH(x) \
+  do { \
+    if (pending_count == pending_capacity) { \
+      pending_capacity = pending_capacity == 0 ? 1024 : pending_capacity * 2; \
+      pending = xrealloc(pending, pending_capacity * sizeof(pending[0])); \
+    } \
+    pending[pending_count++] = (x); \
+  } while (0)
+
+  /* Start from every successor within our range of the edges. A successor
+   * whose edges straddle two ranges is seeded twice, which is harmless.
+   */
+  for (size_t i = w->begin; i < w->end; i++) {
+    if (i == w->begin || w->all[i - 1].successor != w->all[i].successor) {
+      PUSH(w->all[i].successor);
+    }
+  }
+
+  while (pending_count > 0) {
+
+    const size_t t = pending[--pending_count];
+    const struct state *successor = slot_to_state(w->set->bucket[t]);
+
+    uintptr_t live[WORDS];
+    for (size_t i = 0; i < WORDS; i++) {
+      live[i] = __atomic_load_n(&successor->liveness[i], __ATOMIC_RELAXED);
+    }
+
+    /* binary search for the first edge from this successor */
+    size_t lo = 0;
+    size_t hi = w->all_count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (w->all[mid].successor < t) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    for (size_t e = lo; e < w->all_count && w->all[e].successor == t; e++) {
+
+      struct state *s = slot_to_state(w->set->bucket[w->all[e].state]);
+
+      bool learned = false;
+      for (size_t i = 0; i < WORDS; i++) {
+        uintptr_t fresh = live[i] &
+          ~__atomic_load_n(&s->liveness[i], __ATOMIC_RELAXED);
+        if (fresh != 0) {
+          /* As during exploration, a bit newly set by a single atomic operation
+           * is passed on by exactly one thread, so relaxed ordering suffices.
+           */
+          fresh &= ~__atomic_fetch_or(&s->liveness[i], fresh, __ATOMIC_RELAXED);
+          if (fresh != 0) {
+            w->learned += (unsigned long)__builtin_popcountll(
+              (unsigned long long)fresh);
+            learned = true;
+          }
+        }
+      }
+
+      if (learned) {
+        PUSH(w->all[e].state);
+      }
+    }
+  }
+
+#undef PUSH
+  free(pending);
+}
+
+static void *liveness_worker_main(void *arg) {
+  struct liveness_worker *w = arg;
+  thread_id = w->id;
+  local_seen = w->set;
+  if (w->all == NULL) {
+    liveness_collect(w);
+  } else {
+    liveness_propagate(w);
+  }
+  return NULL;
+}
+
+/* run the current step on all workers, the first on the calling thread */
+static void liveness_run(struct liveness_worker *NONNULL workers) {
+
+  pthread_t threads[THREADS];
+  for (size_t i = 1; i < THREADS; i++) {
+    int r = pthread_create(&threads[i], NULL, liveness_worker_main,
+      &workers[i]);
+    if (__builtin_expect(r != 0, 0)) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(r));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  (void)liveness_worker_main(&workers[0]);
+
+  for (size_t i = 1; i < THREADS; i++) {
+    int r = pthread_join(threads[i], NULL);
+    if (__builtin_expect(r != 0, 0)) {
+      fprintf(stderr, "failed to join thread: %s\n", strerror(r));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* restore the calling thread's identity */
+  thread_id = 0;
+}
+
+static void check_liveness_final(void) {
+
+  if (!MACHINE_READABLE_OUTPUT) {
+    put("trying to prove remaining liveness constraints...\n");
+  }
+
+  /* find how many liveness bits are unknown */
+  unsigned long remaining = 0;
+  unsigned long long start = 0;
+  if (!MACHINE_READABLE_OUTPUT) {
+    for (size_t i = 0; i < set_size(local_seen); i++) {
+
+      slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_RELAXED);
+
+      if (slot_is_empty(slot)) {
+        /* skip empty entries in the hash table */
+        continue;
+      }
+
+      remaining += unknown_liveness(slot_to_state(slot));
+    }
+    put("\t ");
+    put_uint(remaining);
+    put(" constraints remaining\n");
+    start = gettime();
+  }
+
+  struct liveness_worker workers[THREADS];
+  memset(workers, 0, sizeof(workers));
+
+  /* first step: collect edges from disjoint ranges of the seen set */
+  const size_t slots = set_size(local_seen);
+  for (size_t i = 0; i < THREADS; i++) {
+    workers[i].id = i;
+    workers[i].set = local_seen;
+    workers[i].begin = slots / THREADS * i;
+    workers[i].end = i == THREADS - 1 ? slots : slots / THREADS * (i + 1);
+  }
+  liveness_run(workers);
+
+  /* combine and sort the edges by successor */
+  size_t count = 0;
+  for (size_t i = 0; i < THREADS; i++) {
+    count += workers[i].edges.count;
+  }
+  struct liveness_edge *all = xmalloc(sizeof(all[0]) * (count == 0 ? 1 : count));
+  for (size_t i = 0, offset = 0; i < THREADS; i++) {
+    if (workers[i].edges.count > 0) {
+      memcpy(&all[offset], workers[i].edges.edges,
+        sizeof(all[0]) * workers[i].edges.count);
+    }
+    offset += workers[i].edges.count;
+    free(workers[i].edges.edges);
+  }
+  qsort(all, count, sizeof(all[0]), liveness_edge_compare);
+
+  /* second step: propagate from disjoint ranges of the edges */
+  for (size_t i = 0; i < THREADS; i++) {
+    workers[i].begin = count / THREADS * i;
+    workers[i].end = i == THREADS - 1 ? count : count / THREADS * (i + 1);
+    workers[i].all = all;
+    workers[i].all_count = count;
+  }
+  liveness_run(workers);
+
+  free(all);
+
+  if (!MACHINE_READABLE_OUTPUT) {
+    unsigned long learned = 0;
+    for (size_t i = 0; i < THREADS; i++) {
+      learned += workers[i].learned;
+    }
+    put("\t ");
+    put_uint(learned);
+    put(" further liveness constraints proved in ");
+    put_uint(gettime() - start);
+    put("s, with ");
+    put(green()); put_uint(remaining - learned); put(reset());
+    put(" remaining\n");
+  }
+}
+
+/* Print a counterexample to a liveness property, given a state `s` (at slot
+ * `index` of the seen set) from which the property is never satisfied. Every
+ * successor of such a state is likewise unable to satisfy the property, so
+ * following successors from `s` must eventually either revisit a state or
+ * reach one with no successors. We print the trace to `s` followed by this
+ * path, with any cycle it closes marked as a loop.
+ */
+static void print_liveness_counterexample(
+    const struct state *NONNULL s __attribute__((unused)),
+    size_t index __attribute__((unused)),
+    size_t word_index __attribute__((unused)),
+    size_t bit_index __attribute__((unused))) {
+
+  print_counterexample(s);
+
+#if COUNTEREXAMPLE_TRACE != CEX_OFF
+  /* the path we have walked, as seen set slots and the states reached */
+  size_t *slots = NULL;
+  struct state **path = NULL;
+  size_t length = 0;
+  size_t capacity = 0;
+
+  /* which seen set slots we have visited */
+  const size_t slot_count = set_size(local_seen);
+  uint8_t *visited = xcalloc(slot_count / CHAR_BIT + 1, sizeof(visited[0]));
+  visited[index / CHAR_BIT] |= (uint8_t)(1u << (index % CHAR_BIT));
+
+  /* position in the path at which a cycle begins (SIZE_MAX if none) */
+  size_t loop = SIZE_MAX;
+
+  const struct state *current = s;
+  size_t current_slot = index;
+  for (;;) {
+
+#if BOUND > 0
+    if (state_bound_get(current) == BOUND) {
+      /* we cannot follow successors beyond the exploration bound */
+      break;
+    }
+#endif
+
+    struct liveness_edges successors = { .keep_successors = true };
+    liveness_expand(current, current_slot, &successors);
+
+    /* Find a successor that also never satisfies the property. Note that we
+     * do not free the other successors, as states come from an arena that can
+     * only release its most recent allocation. The checker is about to exit,
+     * so these are not worth reclaiming.
+     */
+    struct state *next = NULL;
+    size_t next_slot = SIZE_MAX;
+    for (size_t i = 0; i < successors.count && next == NULL; i++) {
+      const size_t slot = successors.edges[i].successor;
+      const struct state *t = slot_to_state(local_seen->bucket[slot]);
+      if (!((t->liveness[word_index] >> bit_index) & 0x1)) {
+        next = successors.successors[i];
+        next_slot = slot;
+      }
+    }
+    ASSERT((successors.count == 0 || next != NULL) &&
+      "a state missing a liveness property has a successor satisfying it");
+    free(successors.edges);
+    free(successors.successors);
+
+    if (next == NULL) {
+      /* no successors */
+      break;
+    }
+
+    if (length == capacity) {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      slots = xrealloc(slots, capacity * sizeof(slots[0]));
+      path = xrealloc(path, capacity * sizeof(path[0]));
+    }
+    slots[length] = next_slot;
+    path[length] = next;
+    length++;
+
+    if (visited[next_slot / CHAR_BIT] & (1u << (next_slot % CHAR_BIT))) {
+      /* we have closed a cycle, so find where it began */
+      if (next_slot == index) {
+        loop = 0;
+      } else {
+        for (loop = 0; slots[loop] != next_slot; loop++) {
+          ASSERT(loop < length - 1 && "visited state missing from path");
+        }
+        loop++;
+      }
+      break;
+    }
+    visited[next_slot / CHAR_BIT] |= (uint8_t)(1u << (next_slot % CHAR_BIT));
+
+    current = next;
+    current_slot = next_slot;
+  }
+
+  free(visited);
+
+  for (size_t i = 0; i < length; i++) {
+
+    if (i == loop) {
+      if (MACHINE_READABLE_OUTPUT) {
+        put("<loop>\n");
+      } else {
+        put("The following cycle then repeats forever:\n\n");
+      }
+    }
+
+    const struct state *previous = i == 0 ? s : path[i - 1];
+
+    print_transition(previous, path[i]);
+
+    if (MACHINE_READABLE_OUTPUT) {
+      put("<state>\n");
+    }
+    state_print(COUNTEREXAMPLE_TRACE == FULL ? NULL : previous, path[i]);
+    if (MACHINE_READABLE_OUTPUT) {
+      put("</state>\n");
+    } else {
+      put("----------\n\n");
+    }
+  }
+
+  if (loop != SIZE_MAX && MACHINE_READABLE_OUTPUT) {
+    put("</loop>\n");
+  }
+
+  free(path);
+  free(slots);
+#endif
+}
+#endif
+#if RULE_STATISTICS > 0
+static void print_rule_statistics(void);
+#endif
+
+#if RULE_PROFILE_RULES > 0
+static void rule_profile_write(void) {
+
+  fprintf(rule_profile_file, "# rumur rule profile\n"
+    "# evaluated enabled successors fresh rule\n");
+
+  for (size_t i = 0; i < RULE_PROFILE_RULES; i++) {
+    struct rule_profile total = { 0 };
+    for (size_t j = 0; j < THREADS; j++) {
+      total.evaluated += rule_profile[j][i].evaluated;
+      total.enabled += rule_profile[j][i].enabled;
+      total.successors += rule_profile[j][i].successors;
+      total.fresh += rule_profile[j][i].fresh;
+    }
+    fprintf(rule_profile_file, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+      " %s\n", total.evaluated, total.enabled, total.successors, total.fresh,
+      RULE_PROFILE_NAMES[i]);
+  }
+
+  /* We cannot close the file within the sandbox, so just make sure its content
+   * is written.
+   */
+  if (fflush(rule_profile_file) != 0) {
+    fprintf(stderr, "failed to write rule profile: %s\n", strerror(errno));
+  }
+}
+#endif
+
+#if RULE_STATISTICS > 0
+/* Time is measured in cycles where the processor has a cheap cycle counter and
+ * in nanoseconds otherwise.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+static const char RULE_STATISTICS_UNIT[] = "cycles";
+#else
+static const char RULE_STATISTICS_UNIT[] = "ns";
+#endif
+
+static uint64_t rule_statistics_now(void) {
+#if defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void rule_statistics_init(void) {
+  rule_statistics_local = xcalloc(RULE_STATISTICS,
+    sizeof(rule_statistics_local[0]));
+}
+
+/* Total the counters of a range of rule instances across all threads. */
+static struct rule_statistics rule_statistics_sum(size_t first, size_t count) {
+  struct rule_statistics total = { 0 };
+  for (size_t i = 0; i < THREADS; i++) {
+    if (rule_statistics[i] == NULL) {
+      /* this thread was never started */
+      continue;
+    }
+    for (size_t j = first; j < first + count; j++) {
+      total.evaluated += rule_statistics[i][j].evaluated;
+      total.fired += rule_statistics[i][j].fired;
+      total.fresh += rule_statistics[i][j].fresh;
+      total.duplicates += rule_statistics[i][j].duplicates;
+      total.guards += rule_statistics[i][j].guards;
+      total.time += rule_statistics[i][j].time;
+    }
+  }
+  return total;
+}
+
+/* Print counters, as XML attributes in machine readable mode. */
+static void rule_statistics_put(const struct rule_statistics *NONNULL st) {
+  if (MACHINE_READABLE_OUTPUT) {
+    put(" evaluated=\"");
+    put_uint(st->evaluated);
+    put("\" fired=\"");
+    put_uint(st->fired);
+    put("\" new_states=\"");
+    put_uint(st->fresh);
+    put("\" duplicates=\"");
+    put_uint(st->duplicates);
+    put("\" guards=\"");
+    put_uint(st->guards);
+    put("\" time=\"");
+    put_uint(st->time);
+    put("\"");
+  } else {
+    put_uint(st->evaluated);
+    put(" tried, ");
+    put_uint(st->fired);
+    put(" fired, ");
+    put_uint(st->fresh);
+    put(" new states, ");
+    put_uint(st->duplicates);
+    put(" duplicates, ");
+    put_uint(st->guards);
+    put(" guards evaluated, ");
+    put_uint(st->time);
+    put(" ");
+    put(RULE_STATISTICS_UNIT);
+  }
+}
+
+/* A rule as described to rule_statistics_report(). */
+struct rule_statistics_rule {
+  const char *name;
+  size_t first; /* rule_taken - 1 of its first instance */
+  size_t count; /* number of instances */
+  void (*print_instances)(void); /* per-instance breakdown, if quantified */
+  struct rule_statistics total;
+};
+
+static int rule_statistics_compare(const void *a, const void *b) {
+  const struct rule_statistics_rule *x = a;
+  const struct rule_statistics_rule *y = b;
+  if (x->total.time > y->total.time) {
+    return -1;
+  }
+  if (x->total.time < y->total.time) {
+    return 1;
+  }
+  return 0;
+}
+
+/* Print the counters of each rule, hottest first. */
+static void rule_statistics_report(struct rule_statistics_rule *NONNULL rules,
+    size_t count) {
+
+  uint64_t time = 0;
+  for (size_t i = 0; i < count; i++) {
+    rules[i].total = rule_statistics_sum(rules[i].first, rules[i].count);
+    time += rules[i].total.time;
+  }
+
+  qsort(rules, count, sizeof(rules[0]), rule_statistics_compare);
+
+  if (MACHINE_READABLE_OUTPUT) {
+    put("<rule_statistics unit=\"");
+    put(RULE_STATISTICS_UNIT);
+    put("\">\n");
+  } else {
+    put("\n"
+        "==========================================================================\n"
+        "\n"
+        "Rule statistics (time in ");
+    put(RULE_STATISTICS_UNIT);
+    put("):\n\n");
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (MACHINE_READABLE_OUTPUT) {
+      put("<rule name=\"");
+      xml_printf(rules[i].name);
+      put("\"");
+      rule_statistics_put(&rules[i].total);
+      put(">\n");
+    } else {
+      put("\t");
+      put(rules[i].name);
+      put(": ");
+      rule_statistics_put(&rules[i].total);
+      if (time > 0) {
+        put(" (");
+        put_uint(rules[i].total.time * 100 / time);
+        put("%)");
+      }
+      put("\n");
+    }
+    if (rules[i].print_instances != NULL) {
+      rules[i].print_instances();
+    }
+    if (MACHINE_READABLE_OUTPUT) {
+      put("</rule>\n");
+    }
+  }
+
+  if (MACHINE_READABLE_OUTPUT) {
+    put("</rule_statistics>\n");
+  }
+}
+#endif
+
+static int exit_with(int status) {
+
+  /* We may be exiting because of an error, which parked threads need to notice
+   * to exit themselves.
+   */
+  idle_wake(INT_MAX);
+
+  /* Give up our reference to the seen set. */
+  set_release(local_seen);
+  local_seen = NULL;
+
+  /* Make fired rule count visible globally. */
+  rules_fired[thread_id] = rules_fired_local;
+#if EDGE_LOG
+  edge_logs[thread_id] = edge_log_local;
+#endif
+#if RULE_STATISTICS > 0
+  rule_statistics[thread_id] = rule_statistics_local;
+#endif
+#if RULE_PROFILE_RULES > 0
+  memcpy(rule_profile[thread_id], rule_profile_local,
+    sizeof(rule_profile_local));
+#endif
+
+  if (thread_id == 0) {
+    /* We are the initial thread. Wait on the others before exiting. */
+#ifdef __clang__
+  #pragma clang diagnostic push
+  #pragma clang diagnostic ignored "-Wtautological-compare"
+  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wtype-limits"
+#endif
+    for (size_t i = 0; phase == RUN &&
+         i < sizeof(threads) / sizeof(threads[0]); i++) {
+#ifdef __clang__
+  #pragma clang diagnostic pop
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic pop
+#endif
+      void *ret;
+      int r = pthread_join(threads[i], &ret);
+      if (__builtin_expect(r != 0, 0)) {
+        flockfile(stdout);
+        fprintf(stderr, "failed to join thread: %s\n", strerror(r));
+        funlockfile(stdout);
+        continue;
+      }
+      status |= (int)(intptr_t)ret;
+    }
+
+    /* We're now single-threaded again. */
+
+    /* Threads that found errors without reaching MAX_ERRORS still finished
+     * exploring successfully, but the run as a whole should fail.
+     */
+    if (error_count > 0) {
+      status = EXIT_FAILURE;
+    }
+
+    /* Reacquire a pointer to the seen set. Note that this may not be the same
+     * value as what we previously had in local_seen because the other threads
+     * may have expanded and migrated the seen set in the meantime.
+     */
+    local_seen = refcounted_ptr_get(&global_seen);
+
+    if (error_count == 0) {
+      /* If we didn't see any other errors, print cover information. */
+#ifdef __clang__
+  #pragma clang diagnostic push
+  #pragma clang diagnostic ignored "-Wtautological-compare"
+  #pragma clang diagnostic ignored "-Wtautological-unsigned-zero-compare"
+#elif defined(__GNUC__)
+  #pragma GCC diagnostic push
+  #pragma GCC diagnostic ignored "-Wtype-limits"
+#endif
+      for (size_t i = 0; i < sizeof(covers) / sizeof(covers[0]); i++) {
 #ifdef __clang__
   #pragma clang diagnostic pop
 #elif defined(__GNUC__)
@@ -3707,6 +5980,14 @@ static int exit_with(int status) {
     }
 #endif
 
+#if TELEMETRY_FD >= 0
+    telemetry_sample(true);
+#endif
+
+#if RULE_STATISTICS > 0
+    print_rule_statistics();
+#endif
+
     if (!MACHINE_READABLE_OUTPUT) {
       put("\n"
           "==========================================================================\n"
@@ -3725,6 +6006,10 @@ static int exit_with(int status) {
       put("\n");
     }
 
+#if DEDUPLICATE_ERRORS
+    print_error_classes();
+#endif
+
     /* Calculate the total number of rules fired. */
     uintmax_t fire_count = 0;
     for (size_t i = 0; i < sizeof(rules_fired) / sizeof(rules_fired[0]); i++) {
@@ -3769,8 +6054,18 @@ static int exit_with(int status) {
     /* print memory usage statistics if `--trace memory_usage` is in effect */
     print_allocation_summary();
 
+#if RULE_PROFILE_RULES > 0
+    rule_profile_write();
+#endif
+
     exit(status);
   } else {
+    /* Our output buffer goes away with us, so write out anything left in it.
+     */
+    output_flush();
+    free(output.data);
+    output = (struct output_buffer){ 0 };
+
     pthread_exit((void*)(intptr_t)status);
   }
 }
@@ -3780,25 +6075,29 @@ static void *thread_main(void *arg) {
   /* Initialize (thread-local) thread identifier. */
   thread_id = (size_t)(uintptr_t)arg;
 
-  set_thread_init();
+  /* Our reference to the seen set was taken by start_secondary_threads(), so
+   * the set has not been freed even if it has since been expanded.
+   */
+  local_seen = refcounted_ptr_peek(&global_seen);
+
+#if RULE_STATISTICS > 0
+  rule_statistics_init();
+#endif
 
   explore();
 }
 
 static void start_secondary_threads(void) {
 
-  /* XXX: Kind of hacky. We've left the rendezvous down-counter at 1 until now
-   * in case we triggered a rendezvous before starting the other threads (it
-   * *can* happen). We bump it immediately -- i.e. before starting *any* of the
-   * secondary threads -- because any of them could race us and trigger a
-   * rendezvous before we exit the below loop and they need to know about the
-   * thundering herd bearing down on them. It is safe to do this without holding
-   * rendezvous_lock because we are still single threaded at this point.
+  /* Take references to the seen set on behalf of the threads we are about to
+   * start. If they took their own, we could race them by expanding the set and
+   * freeing the old one before they get to it. We are still single threaded at
+   * this point, so the set is not mid expansion.
    */
-  assert(running_count == 1);
-  running_count = THREADS;
-  assert(rendezvous_pending == 1);
-  rendezvous_pending = THREADS;
+  assert(refcounted_ptr_peek(&next_global_seen) == NULL);
+  for (size_t i = 1; i < THREADS; i++) {
+    (void)refcounted_ptr_get(&global_seen);
+  }
 
 #ifdef __clang__
   #pragma clang diagnostic push
@@ -3831,6 +6130,25 @@ int main(void) {
   /* We don't need to read anything from stdin, so discard it. */
   (void)fclose(stdin);
 
+  /* Write out any incomplete line of output if we exit abruptly. */
+  if (__builtin_expect(atexit(output_flush) != 0, 0)) {
+    fputs("failed to register output flushing\n", stderr);
+    exit(EXIT_FAILURE);
+  }
+
+#if RULE_PROFILE_RULES > 0
+  rule_profile_file = fopen(RULE_PROFILE_PATH, "w");
+  if (rule_profile_file == NULL) {
+    fprintf(stderr, "failed to open %s: %s\n", RULE_PROFILE_PATH,
+      strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+#endif
+
+#if METRICS_SOCKET
+  metrics_listen();
+#endif
+
   sandbox();
 
   if (MACHINE_READABLE_OUTPUT) {
@@ -3840,6 +6158,8 @@ int main(void) {
     put_uint(STATE_SIZE_BITS);
     put("\" state_size_bytes=\"");
     put_uint(STATE_SIZE_BYTES);
+    put("\" packed_state_size_bits=\"");
+    put_uint(PACKED_STATE_SIZE_BITS);
     put("\" hash_table_slots=\"");
     put_uint(((size_t)1) << INITIAL_SET_SIZE_EXPONENT);
     put("\"/>\n");
@@ -3850,8 +6170,21 @@ int main(void) {
     put_uint(STATE_SIZE_BITS);
     put(" bits (rounded up to ");
     put_uint(STATE_SIZE_BYTES);
-    put(" bytes).\n"
-        "\t* The size of the hash table is ");
+    put(" bytes).\n");
+    if ((size_t)STATE_SIZE_BITS > (size_t)PACKED_STATE_SIZE_BITS) {
+      put("\t* Aligning state variables for faster access adds ");
+      put_uint(STATE_SIZE_BITS - PACKED_STATE_SIZE_BITS);
+      put(" bits of padding\n"
+          "\t  (each state would be ");
+      put_uint(PACKED_STATE_SIZE_BITS);
+      put(" bits if bit-packed).\n");
+    }
+    if (GUARD_CACHE_BITS > 0) {
+      put("\t* Caching rule guard results adds ");
+      put_uint(2 * BITS_TO_BYTES(GUARD_CACHE_BITS));
+      put(" bytes to each state.\n");
+    }
+    put("\t* The size of the hash table is ");
     put_uint(((size_t)1) << INITIAL_SET_SIZE_EXPONENT);
     put(" slots.\n"
         "\n");
@@ -3863,15 +6196,36 @@ int main(void) {
 
   START_TIME = time(NULL);
 
-  rendezvous_init();
-
   set_init();
 
   set_thread_init();
 
+#if RULE_STATISTICS > 0
+  rule_statistics_init();
+#endif
+
+  if (EAGER_STARTUP) {
+    /* Other threads may report progress before the start states are done. */
+    if (!MACHINE_READABLE_OUTPUT) {
+      put("Progress Report:\n\n");
+    }
+    if (THREADS > 1) {
+      start_secondary_threads();
+      phase = RUN;
+    }
+  }
+
   init();
 
-  if (!MACHINE_READABLE_OUTPUT) {
+#if TELEMETRY_FD >= 0
+  start_telemetry();
+#endif
+
+#if METRICS_SOCKET
+  start_metrics();
+#endif
+
+  if (!EAGER_STARTUP && !MACHINE_READABLE_OUTPUT) {
     put("Progress Report:\n\n");
   }
 
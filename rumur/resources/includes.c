@@ -4,12 +4,20 @@
   #define _POSIX_C_SOURCE 200809L
 #endif
 
+/* Also expose syscall(), used to park idle threads on a futex. */
+#ifdef __linux__
+  #define _DEFAULT_SOURCE
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -17,10 +25,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef __linux__
+  #include <linux/futex.h>
   #include <linux/version.h>
+  #include <sys/syscall.h>
 #endif
 
 #ifdef __APPLE__
@@ -0,0 +1,53 @@
+#include "align-fields.h"
+#include <cstddef>
+#include <gmpxx.h>
+#include "log.h"
+#include <rumur/rumur.h>
+#include "utils.h"
+
+using namespace rumur;
+
+// the alignment, in bits, to give a variable of the given type
+static mpz_class alignment(const TypeExpr &t) {
+
+  mpz_class width = t.width();
+
+  // zero-width variables occupy no space and can go anywhere
+  if (width == 0)
+    return 1;
+
+  // complex types, or simple types too wide for a machine word, only get byte
+  // alignment
+  if (!t.is_simple() || width > 64)
+    return 8;
+
+  // otherwise, align to the smallest integer type this fits in
+  mpz_class a = 8;
+  while (a < width)
+    a *= 2;
+  return a;
+}
+
+void align_fields(Model &m) {
+
+  mpz_class offset = 0;
+
+  for (Ptr<Decl> &d : m.decls) {
+    if (auto v = dynamic_cast<VarDecl*>(d.get())) {
+
+      const mpz_class align = alignment(*v->type);
+      if (offset % align != 0)
+        offset += align - offset % align;
+
+      if (v->offset != offset)
+        *debug << "moved " << v->name << " from state offset " << v->offset
+          << " to " << offset << "\n";
+
+      v->offset = offset;
+      offset += v->type->width();
+    }
+  }
+
+  // update references to the variables we have moved
+  update_state_offsets(m);
+}
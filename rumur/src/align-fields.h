@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <rumur/rumur.h>
+
+/** Re-layout the state variables of a model so each is byte-aligned.
+ *
+ * By default state variables are bit-packed back-to-back, which minimises the
+ * size of a state but means most accesses in the generated checker have to
+ * shift and mask across byte boundaries. This pass instead places each
+ * variable of simple type at the natural boundary of the smallest integer type
+ * that can hold it (1, 2, 4 or 8 bytes) and each variable of complex type at a
+ * byte boundary. The contents of records and arrays are left compact.
+ *
+ * This assumes variable offsets have already been computed, e.g. by
+ * resolve_symbols() or optimise_field_ordering().
+ */
+void align_fields(rumur::Model &m);
@@ -0,0 +1,779 @@
+#include <cassert>
+#include <cstddef>
+#include "fold-constants.h"
+#include <gmpxx.h>
+#include "log.h"
+#include "options.h"
+#include <rumur/rumur.h>
+#include <stdexcept>
+#include <string>
+#include "utils.h"
+#include <utility>
+#include "ValueType.h"
+#include <vector>
+
+using namespace rumur;
+
+// maximum number of statements a for loop may expand into when unrolled
+static const size_t UNROLL_LIMIT = 16;
+
+namespace {
+
+// does a node contain a cover property?
+class CoverFinder : public ConstTraversal {
+
+ public:
+  bool result = false;
+
+  void visit_propertystmt(const PropertyStmt &n) final {
+    if (n.property.category == Property::COVER)
+      result = true;
+  }
+
+  void visit_propertyrule(const PropertyRule &n) final {
+    if (n.property.category == Property::COVER)
+      result = true;
+  }
+
+  virtual ~CoverFinder() = default;
+};
+
+/* Covers are reported by name regardless of whether they were hit, so code
+ * containing them cannot be removed or duplicated without changing the report.
+ */
+static bool has_cover(const Node &n) {
+  CoverFinder finder;
+  finder.dispatch(n);
+  return finder.result;
+}
+
+// replace references to a quantified variable with a constant
+class Substituter : public Traversal {
+
+ private:
+  size_t id;
+  Ptr<ConstDecl> value;
+
+ public:
+  Substituter(const VarDecl &variable, const mpz_class &v, const location &loc):
+    id(variable.unique_id),
+    value(Ptr<ConstDecl>::make(variable.name, Ptr<Number>::make(v, loc), loc))
+    { }
+
+  void visit_exprid(ExprID &n) final {
+    if (n.value != nullptr && n.value->unique_id == id)
+      n.value = value;
+  }
+
+  virtual ~Substituter() = default;
+};
+
+/* Does a constant expression compute any intermediate value outside a given
+ * range? The checker evaluates expressions within the range of its value type,
+ * so folding these would hide an overflow it would otherwise report.
+ */
+class OverflowFinder : public ConstTraversal {
+
+ private:
+  const mpz_class &min;
+  const mpz_class &max;
+
+ public:
+  bool result = false;
+
+  OverflowFinder(const mpz_class &min_, const mpz_class &max_):
+    min(min_), max(max_) { }
+
+  void visit_add(const Add &n) final {
+    check(n);
+    ConstTraversal::visit_add(n);
+  }
+
+  void visit_band(const Band &n) final {
+    check(n);
+    ConstTraversal::visit_band(n);
+  }
+
+  void visit_bnot(const Bnot &n) final {
+    check(n);
+    ConstTraversal::visit_bnot(n);
+  }
+
+  void visit_bor(const Bor &n) final {
+    check(n);
+    ConstTraversal::visit_bor(n);
+  }
+
+  void visit_div(const Div &n) final {
+    check(n);
+    ConstTraversal::visit_div(n);
+  }
+
+  void visit_lsh(const Lsh &n) final {
+    check(n);
+    ConstTraversal::visit_lsh(n);
+  }
+
+  void visit_mod(const Mod &n) final {
+    check(n);
+    ConstTraversal::visit_mod(n);
+  }
+
+  void visit_mul(const Mul &n) final {
+    check(n);
+    ConstTraversal::visit_mul(n);
+  }
+
+  void visit_negative(const Negative &n) final {
+    check(n);
+    ConstTraversal::visit_negative(n);
+  }
+
+  void visit_rsh(const Rsh &n) final {
+    check(n);
+    ConstTraversal::visit_rsh(n);
+  }
+
+  void visit_sub(const Sub &n) final {
+    check(n);
+    ConstTraversal::visit_sub(n);
+  }
+
+  void visit_xor(const Xor &n) final {
+    check(n);
+    ConstTraversal::visit_xor(n);
+  }
+
+  virtual ~OverflowFinder() = default;
+
+ private:
+  void check(const Expr &e) {
+    if (!e.constant())
+      return;
+    try {
+      mpz_class v = e.constant_fold();
+      if (v < min || v > max)
+        result = true;
+    } catch (Error&) {
+      result = true;
+    }
+  }
+};
+
+class Folder : public BaseTraversal {
+
+ private:
+  /* Position of the SimpleRule being visited among all SimpleRules in the
+   * model, and the position of the last one that is unnamed. Unnamed rules are
+   * identified to the user by their position, so a rule before the last
+   * unnamed rule cannot be removed without changing how it is identified.
+   */
+  size_t rule_index = 0;
+  size_t last_unnamed = 0;
+  bool any_unnamed = false;
+
+  // range of the checker's value type
+  mpz_class min;
+  mpz_class max;
+
+ public:
+  Folder(const mpz_class &min_, const mpz_class &max_): min(min_), max(max_) { }
+
+  void visit_add(Add &n) final { visit_bexpr(n); }
+
+  void visit_aliasdecl(AliasDecl &n) final {
+    dispatch(*n.value);
+    fold(n.value);
+  }
+
+  void visit_aliasrule(AliasRule &n) final {
+    for (Ptr<AliasDecl> &alias : n.aliases)
+      dispatch(*alias);
+    simplify_rules(n.rules);
+  }
+
+  void visit_aliasstmt(AliasStmt &n) final {
+    for (Ptr<AliasDecl> &alias : n.aliases)
+      dispatch(*alias);
+    simplify_body(n.body);
+  }
+
+  void visit_and(And &n) final { visit_bexpr(n); }
+
+  void visit_array(Array &n) final {
+    dispatch(*n.index_type);
+    dispatch(*n.element_type);
+  }
+
+  void visit_assignment(Assignment &n) final {
+    dispatch(*n.lhs);
+    dispatch(*n.rhs);
+
+    fold(n.rhs);
+  }
+
+  void visit_band(Band &n) final { visit_bexpr(n); }
+  void visit_bnot(Bnot &n) final { visit_uexpr(n); }
+  void visit_bor(Bor &n) final { visit_bexpr(n); }
+
+  void visit_clear(Clear &n) final {
+    dispatch(*n.rhs);
+  }
+
+  void visit_constdecl(ConstDecl &n) final {
+    dispatch(*n.value);
+
+    if (n.type != nullptr)
+      dispatch(*n.type);
+  }
+
+  void visit_div(Div &n) final { visit_bexpr(n); }
+
+  void visit_element(Element &n) final {
+    dispatch(*n.array);
+    dispatch(*n.index);
+
+    fold(n.index);
+  }
+
+  void visit_enum(Enum&) final { }
+
+  void visit_eq(Eq &n) final { visit_bexpr(n); }
+  void visit_errorstmt(ErrorStmt&) final { }
+
+  void visit_exists(Exists &n) final {
+    dispatch(n.quantifier);
+    dispatch(*n.expr);
+
+    fold(n.expr);
+  }
+
+  void visit_exprid(ExprID&) final { }
+
+  void visit_field(Field &n) final {
+    dispatch(*n.record);
+  }
+
+  void visit_for(For &n) final {
+    dispatch(n.quantifier);
+    simplify_body(n.body);
+  }
+
+  void visit_forall(Forall &n) final {
+    dispatch(n.quantifier);
+    dispatch(*n.expr);
+
+    fold(n.expr);
+  }
+
+  void visit_function(Function &n) final {
+    for (Ptr<VarDecl> &parameter : n.parameters)
+      dispatch(*parameter);
+    if (n.return_type != nullptr)
+      dispatch(*n.return_type);
+    for (Ptr<Decl> &decl : n.decls)
+      dispatch(*decl);
+    simplify_body(n.body);
+  }
+
+  void visit_functioncall(FunctionCall &n) final {
+    for (Ptr<Expr> &arg : n.arguments) {
+      dispatch(*arg);
+      // leave arguments that could be passed by reference intact
+      if (!arg->is_lvalue())
+        fold(arg);
+    }
+  }
+
+  void visit_geq(Geq &n) final { visit_bexpr(n); }
+  void visit_gt(Gt &n) final { visit_bexpr(n); }
+
+  void visit_if(If &n) final {
+    for (IfClause &c : n.clauses)
+      dispatch(c);
+  }
+
+  void visit_ifclause(IfClause &n) final {
+    if (n.condition != nullptr) {
+      dispatch(*n.condition);
+      fold(n.condition);
+    }
+
+    simplify_body(n.body);
+  }
+
+  void visit_implication(Implication &n) final { visit_bexpr(n); }
+  void visit_isundefined(IsUndefined&) final { }
+  void visit_leq(Leq &n) final { visit_bexpr(n); }
+  void visit_lsh(Lsh &n) final { visit_bexpr(n); }
+  void visit_lt(Lt &n) final { visit_bexpr(n); }
+  void visit_mod(Mod &n) final { visit_bexpr(n); }
+
+  void visit_model(Model &n) final {
+    // find the last unnamed rule before we start removing any
+    {
+      std::vector<Ptr<Rule>> flat;
+      for (const Ptr<Rule> &r : n.rules) {
+        std::vector<Ptr<Rule>> rs = r->flatten();
+        flat.insert(flat.end(), rs.begin(), rs.end());
+      }
+      size_t index = 0;
+      for (const Ptr<Rule> &r : flat) {
+        if (isa<SimpleRule>(r)) {
+          if (r->name == "") {
+            last_unnamed = index;
+            any_unnamed = true;
+          }
+          index++;
+        }
+      }
+    }
+
+    for (Ptr<Decl> &decl : n.decls)
+      dispatch(*decl);
+    for (Ptr<Function> &function : n.functions)
+      dispatch(*function);
+    simplify_rules(n.rules);
+  }
+
+  void visit_mul(Mul &n) final { visit_bexpr(n); }
+  void visit_negative(Negative &n) final { visit_uexpr(n); }
+  void visit_neq(Neq &n) final { visit_bexpr(n); }
+  void visit_not(Not &n) final { visit_uexpr(n); }
+  void visit_number(Number&) final { }
+  void visit_or(Or &n) final { visit_bexpr(n); }
+
+  void visit_procedurecall(ProcedureCall &n) final {
+    dispatch(n.call);
+  }
+
+  void visit_property(Property&) final {
+    /* properties are printed to the user during verification, so leave them
+     * as the user wrote them
+     */
+  }
+
+  void visit_propertyrule(PropertyRule &n) final {
+    for (Quantifier &quantifier : n.quantifiers)
+      dispatch(quantifier);
+    for (Ptr<AliasDecl> &alias : n.aliases)
+      dispatch(*alias);
+    dispatch(n.property);
+  }
+
+  void visit_propertystmt(PropertyStmt &n) final {
+    dispatch(n.property);
+  }
+
+  void visit_put(Put&) final {
+    // the expression in a 'put' statement is displayed to the user, so leave it
+  }
+
+  void visit_quantifier(Quantifier &n) final {
+    if (n.type != nullptr) {
+      dispatch(*n.type);
+    } else {
+      assert(n.from != nullptr);
+      assert(n.to != nullptr);
+
+      dispatch(*n.from);
+      dispatch(*n.to);
+      if (n.step != nullptr)
+        dispatch(*n.step);
+
+      fold(n.from);
+      fold(n.to);
+      if (n.step != nullptr)
+        fold(n.step);
+    }
+  }
+
+  void visit_range(Range &n) final {
+    dispatch(*n.min);
+    dispatch(*n.max);
+  }
+
+  void visit_record(Record &n) final {
+    for (Ptr<VarDecl> &field : n.fields)
+      dispatch(*field);
+  }
+
+  void visit_return(Return &n) final {
+    if (n.expr != nullptr) {
+      dispatch(*n.expr);
+      // a returned lvalue may be needed as one
+      if (!n.expr->is_lvalue())
+        fold(n.expr);
+    }
+  }
+
+  void visit_rsh(Rsh &n) final { visit_bexpr(n); }
+
+  void visit_ruleset(Ruleset &n) final {
+    for (Quantifier &quantifier : n.quantifiers)
+      dispatch(quantifier);
+    for (Ptr<AliasDecl> &alias : n.aliases)
+      dispatch(*alias);
+    simplify_rules(n.rules);
+  }
+
+  void visit_scalarset(Scalarset &n) final {
+    dispatch(*n.bound);
+  }
+
+  void visit_simplerule(SimpleRule &n) final {
+    for (Quantifier &quantifier : n.quantifiers)
+      dispatch(quantifier);
+    for (Ptr<AliasDecl> &alias : n.aliases)
+      dispatch(*alias);
+    if (n.guard != nullptr) {
+      dispatch(*n.guard);
+      fold(n.guard);
+    }
+    for (Ptr<Decl> &decl : n.decls)
+      dispatch(*decl);
+    simplify_body(n.body);
+  }
+
+  void visit_startstate(StartState &n) final {
+    for (Quantifier &quantifier : n.quantifiers)
+      dispatch(quantifier);
+    for (Ptr<AliasDecl> &alias : n.aliases)
+      dispatch(*alias);
+    for (Ptr<Decl> &decl : n.decls)
+      dispatch(*decl);
+    simplify_body(n.body);
+  }
+
+  void visit_sub(Sub &n) final { visit_bexpr(n); }
+
+  void visit_switchcase(SwitchCase &n) final {
+    for (Ptr<Expr> &match : n.matches) {
+      dispatch(*match);
+      fold(match);
+    }
+    simplify_body(n.body);
+  }
+
+  void visit_switch(Switch &n) final {
+    dispatch(*n.expr);
+    fold(n.expr);
+
+    for (SwitchCase &c : n.cases)
+      dispatch(c);
+  }
+
+  void visit_ternary(Ternary &n) final {
+    dispatch(*n.cond);
+    dispatch(*n.lhs);
+    dispatch(*n.rhs);
+
+    fold(n.cond);
+    fold(n.lhs);
+    fold(n.rhs);
+  }
+
+  void visit_typedecl(TypeDecl &n) final {
+    dispatch(*n.value);
+  }
+
+  void visit_typeexprid(TypeExprID&) final { }
+
+  void visit_undefine(Undefine &n) final {
+    dispatch(*n.rhs);
+  }
+
+  void visit_vardecl(VarDecl &n) final {
+    dispatch(*n.type);
+  }
+
+  void visit_while(While &n) final {
+    dispatch(*n.condition);
+    fold(n.condition);
+
+    simplify_body(n.body);
+  }
+
+  void visit_xor(Xor &n) final { visit_bexpr(n); }
+
+  virtual ~Folder() = default;
+
+ private:
+
+  void visit_bexpr(BinaryExpr &n) {
+    dispatch(*n.lhs);
+    dispatch(*n.rhs);
+
+    fold(n.lhs);
+    fold(n.rhs);
+  }
+
+  void visit_uexpr(UnaryExpr &n) {
+    dispatch(*n.rhs);
+
+    fold(n.rhs);
+  }
+
+  // replace a constant expression with its value
+  void fold(Ptr<Expr> &e) {
+
+    assert(e != nullptr && "attempt to fold a NULL expression");
+
+    // literals are already as simple as they get
+    if (isa<Number>(e) || e->is_literal_true() ||
+        e->is_literal_false())
+      return;
+
+    /* A logical operator whose left operand decides its value never evaluates
+     * its right operand, so the right operand need not be constant.
+     */
+    if (auto a = dynamic_cast<const And*>(e.get())) {
+      if (a->lhs->is_literal_false()) {
+        *debug << e->loc << ": folding \"" << e->to_string() << "\" to false\n";
+        e = Ptr<Expr>(False);
+        return;
+      }
+    }
+    if (auto o = dynamic_cast<const Or*>(e.get())) {
+      if (o->lhs->is_literal_true()) {
+        *debug << e->loc << ": folding \"" << e->to_string() << "\" to true\n";
+        e = Ptr<Expr>(True);
+        return;
+      }
+    }
+    if (auto i = dynamic_cast<const Implication*>(e.get())) {
+      if (i->lhs->is_literal_false()) {
+        *debug << e->loc << ": folding \"" << e->to_string() << "\" to true\n";
+        e = Ptr<Expr>(True);
+        return;
+      }
+    }
+
+    if (!e->constant())
+      return;
+
+    OverflowFinder overflow(min, max);
+    overflow.dispatch(*e);
+    if (overflow.result)
+      return;
+
+    // references to numeric constants are as readable as their values
+    if (isa<ExprID>(e) && !e->is_boolean())
+      return;
+
+    mpz_class value;
+    try {
+      value = e->constant_fold();
+    } catch (Error&) {
+      // leave expressions like division by zero for the verifier to diagnose
+      return;
+    }
+
+    if (e->is_boolean()) {
+      *debug << e->loc << ": folding \"" << e->to_string() << "\" to "
+        << (value == 0 ? "false" : "true") << "\n";
+      e = value == 0 ? Ptr<Expr>(False) : Ptr<Expr>(True);
+      return;
+    }
+
+    // only fold numeric values, as enum and scalarset values are printed
+    // differently
+    const Ptr<TypeExpr> t = e->type()->resolve();
+    if (!isa<Range>(t))
+      return;
+
+    *debug << e->loc << ": folding \"" << e->to_string() << "\" to " << value
+      << "\n";
+    e = Ptr<Number>::make(value, e->loc);
+  }
+
+  /* Try to expand a for loop into a copy of its body for each value of its
+   * quantifier, with references to the quantified variable replaced by the
+   * value.
+   */
+  bool unroll(const For &f, std::vector<Ptr<Stmt>> &result) const {
+
+    const Quantifier &q = f.quantifier;
+
+    // determine the values the loop iterates over
+    mpz_class from, to, step;
+    if (q.type != nullptr) {
+      const Ptr<TypeExpr> t = q.type->resolve();
+      auto r = dynamic_cast<const Range*>(t.get());
+      if (r == nullptr)
+        return false;
+      from = r->min->constant_fold();
+      to = r->max->constant_fold();
+      step = 1;
+    } else {
+      if (!q.from->constant() || !q.to->constant())
+        return false;
+      if (q.step != nullptr && !q.step->constant())
+        return false;
+      try {
+        from = q.from->constant_fold();
+        to = q.to->constant_fold();
+        step = q.step == nullptr ? mpz_class(to >= from ? 1 : -1)
+                                 : q.step->constant_fold();
+      } catch (Error&) {
+        return false;
+      }
+      // leave erroneous iteration for the verifier to diagnose
+      if (step == 0 || (to > from && step < 0) || (to < from && step > 0))
+        return false;
+    }
+
+    const mpz_class iterations = (to - from) / step + 1;
+    if (iterations > UNROLL_LIMIT || iterations * f.body.size() > UNROLL_LIMIT)
+      return false;
+
+    if (has_cover(f))
+      return false;
+
+    *debug << f.loc << ": unrolling for loop of " << iterations
+      << " iteration(s)\n";
+
+    for (mpz_class v = from; step > 0 ? v <= to : v >= to; v += step) {
+      Substituter substituter(*q.decl, v, q.loc);
+      for (const Ptr<Stmt> &s : f.body) {
+        Ptr<Stmt> copy = s;
+        substituter.dispatch(*copy);
+        result.push_back(copy);
+      }
+    }
+
+    return true;
+  }
+
+  // simplify a sequence of statements, removing those that do nothing
+  void simplify_body(std::vector<Ptr<Stmt>> &body) {
+
+    // statements still to process, in reverse order
+    std::vector<Ptr<Stmt>> pending(body.rbegin(), body.rend());
+
+    std::vector<Ptr<Stmt>> result;
+    while (!pending.empty()) {
+      Ptr<Stmt> s = std::move(pending.back());
+      pending.pop_back();
+
+      if (auto f = dynamic_cast<const For*>(s.get())) {
+        std::vector<Ptr<Stmt>> unrolled;
+        if (unroll(*f, unrolled)) {
+          pending.insert(pending.end(), unrolled.rbegin(), unrolled.rend());
+          continue;
+        }
+      }
+
+      dispatch(*s);
+
+      if (auto i = dynamic_cast<If*>(s.get())) {
+        std::vector<IfClause> clauses;
+        for (size_t j = 0; j < i->clauses.size(); j++) {
+          IfClause &c = i->clauses[j];
+          if (c.condition != nullptr && c.condition->is_literal_false() &&
+              !has_cover(c)) {
+            *debug << c.loc << ": removing branch that is never taken\n";
+            continue;
+          }
+          if (c.condition != nullptr && c.condition->is_literal_true()) {
+            // this branch is always taken, so later ones never are
+            bool later_cover = false;
+            for (size_t k = j + 1; k < i->clauses.size(); k++)
+              later_cover |= has_cover(i->clauses[k]);
+            if (!later_cover) {
+              c.condition = nullptr;
+              clauses.push_back(c);
+              if (j + 1 < i->clauses.size())
+                *debug << c.loc << ": removing branches after one always "
+                  << "taken\n";
+              break;
+            }
+          }
+          clauses.push_back(c);
+        }
+        i->clauses = clauses;
+
+        if (i->clauses.empty())
+          continue;
+
+        // an if whose first branch is always taken is just that branch
+        if (i->clauses[0].condition == nullptr) {
+          for (Ptr<Stmt> &t : i->clauses[0].body)
+            result.push_back(std::move(t));
+          continue;
+        }
+      }
+
+      if (auto w = dynamic_cast<const While*>(s.get())) {
+        if (w->condition->is_literal_false() && !has_cover(*w)) {
+          *debug << w->loc << ": removing loop that never executes\n";
+          continue;
+        }
+      }
+
+      result.push_back(std::move(s));
+    }
+
+    body = std::move(result);
+  }
+
+  // simplify a sequence of rules, removing those that can never fire
+  void simplify_rules(std::vector<Ptr<Rule>> &rules) {
+
+    std::vector<Ptr<Rule>> result;
+    for (Ptr<Rule> &r : rules) {
+
+      bool is_simple = isa<SimpleRule>(r);
+      size_t index = rule_index;
+
+      dispatch(*r);
+
+      if (is_simple) {
+        rule_index++;
+        auto &s = dynamic_cast<const SimpleRule&>(*r);
+        if (s.guard != nullptr && s.guard->is_literal_false() &&
+            !has_cover(s) && (!any_unnamed || index >= last_unnamed)) {
+          *debug << s.loc << ": removing rule"
+            << (s.name == "" ? "" : " \"" + s.name + "\"")
+            << " whose guard is always false\n";
+          continue;
+        }
+      }
+
+      // drop rulesets and alias rules that have been emptied
+      if (auto rs = dynamic_cast<const Ruleset*>(r.get())) {
+        if (rs->rules.empty())
+          continue;
+      }
+      if (auto a = dynamic_cast<const AliasRule*>(r.get())) {
+        if (a->rules.empty())
+          continue;
+      }
+
+      result.push_back(std::move(r));
+    }
+
+    rules = std::move(result);
+  }
+}; }
+
+void fold_constants(Model &m) {
+
+  /* Folding must not introduce values the checker could not have computed
+   * itself, so limit it to the range of the value type the unfolded model
+   * would use.
+   */
+  std::pair<ValueType, ValueType> value_types;
+  try {
+    value_types = get_value_type(options.value_type, m);
+  } catch (std::runtime_error&) {
+    // leave it to the caller to diagnose this
+    return;
+  }
+
+  Folder folder(value_types.first.min, value_types.first.max);
+  folder.dispatch(m);
+
+  // unrolling duplicates nodes, so make their identifiers unique again
+  m.reindex();
+}
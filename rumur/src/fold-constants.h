@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <rumur/rumur.h>
+
+/* Simplify the model ahead of code generation by folding constant expressions,
+ * unrolling small for loops with constant bounds, removing branches that can
+ * never be taken and removing rules whose guards are always false. What is
+ * changed is reported to the debug log.
+ */
+void fold_constants(rumur::Model &m);
@@ -3,27 +3,181 @@
 #include "generate.h"
 #include <gmpxx.h>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <rumur/rumur.h>
+#include <sstream>
 #include <string>
 #include "utils.h"
 
 using namespace rumur;
 
+// get the bounds of the index type of an array
+static void get_index_bounds(const Array &a, mpz_class &min, mpz_class &max) {
+
+  const Ptr<TypeExpr> t = a.index_type->resolve();
+  assert(t != nullptr && "array with invalid index type");
+
+  if (auto r = dynamic_cast<const Range*>(t.get())) {
+    min = r->min->constant_fold();
+    max = r->max->constant_fold();
+  } else if (auto e = dynamic_cast<const Enum*>(t.get())) {
+    min = 0;
+    max = e->count() - 1;
+  } else if (auto s = dynamic_cast<const Scalarset*>(t.get())) {
+    min = 0;
+    max = s->bound->constant_fold() - 1;
+  } else {
+    assert(false && "array with invalid index type");
+  }
+}
+
+bool get_state_offset(const Expr &e, mpz_class &offset) {
+
+  // a state variable itself
+  if (auto i = dynamic_cast<const ExprID*>(&e)) {
+    auto v = dynamic_cast<const VarDecl*>(i->value.get());
+    if (v == nullptr || v->offset < 0)
+      return false;
+    offset = v->offset;
+    return true;
+  }
+
+  // a field of a record at a known location
+  if (auto f = dynamic_cast<const Field*>(&e)) {
+    const Ptr<TypeExpr> t = f->record->type()->resolve();
+    auto r = dynamic_cast<const Record*>(t.get());
+    if (r == nullptr)
+      return false;
+    if (!get_state_offset(*f->record, offset))
+      return false;
+    for (const Ptr<VarDecl> &field : r->fields) {
+      if (field->name == f->field)
+        return true;
+      offset += field->type->width();
+    }
+    return false;
+  }
+
+  // a constant-indexed element of an array at a known location
+  if (auto el = dynamic_cast<const Element*>(&e)) {
+    if (!el->index->constant())
+      return false;
+    const Ptr<TypeExpr> t = el->array->type()->resolve();
+    auto a = dynamic_cast<const Array*>(t.get());
+    if (a == nullptr)
+      return false;
+    mpz_class min, max;
+    get_index_bounds(*a, min, max);
+    const mpz_class index = el->index->constant_fold();
+    // leave out-of-range accesses to handle_index() to diagnose at runtime
+    if (index < min || index > max)
+      return false;
+    if (!get_state_offset(*el->array, offset))
+      return false;
+    offset += (index - min) * a->element_type->width();
+    return true;
+  }
+
+  return false;
+}
+
+bool get_quantified_state_offset(const Expr &e, const Quantifier &q,
+    mpz_class &base, mpz_class &stride) {
+
+  // a field of a record whose location depends only on the quantifier
+  if (auto f = dynamic_cast<const Field*>(&e)) {
+    const Ptr<TypeExpr> t = f->record->type()->resolve();
+    auto r = dynamic_cast<const Record*>(t.get());
+    if (r == nullptr)
+      return false;
+    if (!get_quantified_state_offset(*f->record, q, base, stride))
+      return false;
+    for (const Ptr<VarDecl> &field : r->fields) {
+      if (field->name == f->field)
+        return true;
+      base += field->type->width();
+    }
+    return false;
+  }
+
+  // an element of an array at a known location, indexed by the quantifier
+  if (auto el = dynamic_cast<const Element*>(&e)) {
+    auto i = dynamic_cast<const ExprID*>(el->index.get());
+    if (i == nullptr || i->id != q.name)
+      return false;
+    auto v = dynamic_cast<const VarDecl*>(i->value.get());
+    if (v == nullptr || v->offset >= 0)
+      return false;
+    if (q.type == nullptr)
+      return false;
+    const Ptr<TypeExpr> t = el->array->type()->resolve();
+    auto a = dynamic_cast<const Array*>(t.get());
+    if (a == nullptr)
+      return false;
+
+    // the quantifier's whole range must be valid indices, so handle_index()
+    // would never have anything to diagnose
+    mpz_class min, max;
+    get_index_bounds(*a, min, max);
+    const Ptr<TypeExpr> qt = q.type->resolve();
+    mpz_class qmin, qmax;
+    if (auto r = dynamic_cast<const Range*>(qt.get())) {
+      qmin = r->min->constant_fold();
+      qmax = r->max->constant_fold();
+    } else if (auto en = dynamic_cast<const Enum*>(qt.get())) {
+      qmin = 0;
+      qmax = en->count() - 2;
+    } else if (auto sc = dynamic_cast<const Scalarset*>(qt.get())) {
+      qmin = 0;
+      qmax = sc->bound->constant_fold() - 1;
+    } else {
+      return false;
+    }
+    if (qmin < min || qmax > max)
+      return false;
+
+    if (!get_state_offset(*el->array, base))
+      return false;
+    stride = a->element_type->width();
+    base += (qmin - min) * stride;
+    return true;
+  }
+
+  return false;
+}
+
 namespace {
 
+/* Simple values read while evaluating an expression that cannot modify the
+ * state. Reads are identified by a key describing what they read. Generation
+ * happens in two passes: the first counts how often each key is read and the
+ * second reuses the value of the first read for keys read more than once.
+ */
+struct ReadCache {
+  bool emitting = false;
+  std::map<std::string, size_t> uses;
+  std::map<std::string, size_t> slots;
+};
+
 class Generator : public ConstExprTraversal {
 
  private:
   std::ostream *out;
   bool lvalue;
+  ReadCache *cache;
+
+  // are we within the body of an exists or forall?
+  bool quantified = false;
 
  public:
-  Generator(std::ostream &o, bool lvalue_): out(&o), lvalue(lvalue_) { }
+  Generator(std::ostream &o, bool lvalue_, ReadCache *cache_ = nullptr):
+    out(&o), lvalue(lvalue_), cache(cache_) { }
 
   // Make emitting an rvalue more concise below
   Generator &operator<<(const Expr &e) {
-    Generator g(*out, false);
+    Generator g(*out, false, cache);
+    g.quantified = quantified;
     g.dispatch(e);
     return *this;
   }
@@ -85,30 +239,17 @@ class Generator : public ConstExprTraversal {
     auto a = dynamic_cast<const Array&>(*t2);
     mpz_class element_width = a.element_type->width();
 
-    // Second, determine the minimum and maximum values of the array's index type
+    if (!lvalue && a.element_type->is_simple() && generate_state_read(n))
+      return;
 
-    const Ptr<TypeExpr> t3 = a.index_type->resolve();
-    assert(t3 != nullptr && "array with invalid index type");
+    // Second, determine the minimum and maximum values of the array's index type
 
     mpz_class min, max;
-    if (auto r = dynamic_cast<const Range*>(t3.get())) {
-      min = r->min->constant_fold();
-      max = r->max->constant_fold();
-    } else if (auto e = dynamic_cast<const Enum*>(t3.get())) {
-      min = 0;
-      max = e->count() - 1;
-    } else if (auto s = dynamic_cast<const Scalarset*>(t3.get())) {
-      min = 0;
-      max = s->bound->constant_fold() - 1;
-    } else {
-      assert(false && "array with invalid index type");
-    }
+    get_index_bounds(a, min, max);
 
     if (!lvalue && a.element_type->is_simple()) {
-      const std::string lb = a.element_type->lower_bound();
-      const std::string ub = a.element_type->upper_bound();
-      *out << "handle_read(" << to_C_string(n.loc) << ", rule_name, "
-        << to_C_string(n) << ", s, " << lb << ", " << ub << ", ";
+      begin_handle_read(n, a.element_type->lower_bound(),
+        a.element_type->upper_bound());
     }
 
     *out << "handle_index(" << to_C_string(n.loc) << ", rule_name, "
@@ -146,7 +287,12 @@ class Generator : public ConstExprTraversal {
 
     *out << "({ bool result = false; ";
     generate_quantifier_header(*out, n.quantifier);
+    // the quantified variable changes on each iteration, so reads through it
+    // cannot be reused
+    bool saved = quantified;
+    quantified = true;
     *this << "if (" << *n.expr << ") { result = true; break; }";
+    quantified = saved;
     generate_quantifier_footer(*out, n.quantifier);
     *out << " result; })";
   }
@@ -173,11 +319,11 @@ class Generator : public ConstExprTraversal {
       const Ptr<TypeExpr> t = n.type();
       assert((!n.is_lvalue() || t != nullptr) && "lvalue without a type");
 
+      if (!lvalue && n.is_lvalue() && t->is_simple() && generate_state_read(n))
+        return;
+
       if (!lvalue && n.is_lvalue() && t->is_simple()) {
-        const std::string lb = t->lower_bound();
-        const std::string ub = t->upper_bound();
-        *out << "handle_read(" << to_C_string(n.loc) << ", rule_name, "
-          << to_C_string(n) << ", s, " << lb << ", " << ub << ", ";
+        begin_handle_read(n, t->lower_bound(), t->upper_bound());
       }
 
       *out << "ru_" << n.id;
@@ -203,11 +349,11 @@ class Generator : public ConstExprTraversal {
       mpz_class offset = 0;
       for (const Ptr<VarDecl> &f : r->fields) {
         if (f->name == n.field) {
+          if (!lvalue && f->type->is_simple() && generate_state_read(n))
+            return;
           if (!lvalue && f->type->is_simple()) {
-            const std::string lb = f->type->lower_bound();
-            const std::string ub = f->type->upper_bound();
-            *out << "handle_read(" << to_C_string(n.loc) << ", rule_name, "
-              << to_C_string(n) << ", s, " << lb << ", " << ub << ", ";
+            begin_handle_read(n, f->type->lower_bound(),
+              f->type->upper_bound());
           }
           *out << "handle_narrow(";
           if (lvalue) {
@@ -233,7 +379,12 @@ class Generator : public ConstExprTraversal {
 
     *out << "({ bool result = true; ";
     generate_quantifier_header(*out, n.quantifier);
+    // the quantified variable changes on each iteration, so reads through it
+    // cannot be reused
+    bool saved = quantified;
+    quantified = true;
     *this << "if (!" << *n.expr << ") { result = false; break; }";
+    quantified = saved;
     generate_quantifier_footer(*out, n.quantifier);
     *out << " result; })";
   }
@@ -385,7 +536,7 @@ class Generator : public ConstExprTraversal {
             "parameter receiving an argument of a differing width");
 
           *out
-            << "handle_copy(" << handle << ", ";
+            << "handle_copy(s, " << handle << ", ";
           generate_lvalue(*out, *a);
           *out << "); ";
 
@@ -570,6 +721,61 @@ class Generator : public ConstExprTraversal {
   void invalid(const Expr &n) const {
     throw Error("invalid expression used as lvalue", n.loc);
   }
+
+  /* Emit a read of a simple state component whose location is known now,
+   * bypassing handle construction. Returns false if the location is only known
+   * at runtime.
+   */
+  bool generate_state_read(const Expr &n) {
+    mpz_class offset;
+    if (!get_state_offset(n, offset))
+      return false;
+    const Ptr<TypeExpr> t = n.type();
+    const std::string slot
+      = cached_read("state:" + offset.get_str() + ":" + t->width().get_str());
+    if (slot != "") {
+      *out << "state_read_once(&" << slot << "_valid, &" << slot << ", ";
+    } else {
+      *out << "state_read(";
+    }
+    *out << to_C_string(n.loc) << ", rule_name, " << to_C_string(n) << ", s, "
+      << t->lower_bound() << ", " << t->upper_bound() << ", " << offset
+      << "ull, " << t->width() << "ull)";
+    return true;
+  }
+
+  /* Emit the leading part of a handle_read() call for the given expression,
+   * up to its handle argument. Outside of exists and forall bodies, the same
+   * source text always denotes the same location, so it is used to identify
+   * reads that can be reused.
+   */
+  void begin_handle_read(const Expr &n, const std::string &lb,
+      const std::string &ub) {
+    const std::string slot = quantified ? "" : cached_read(n.to_string());
+    if (slot != "") {
+      *out << "handle_read_once(&" << slot << "_valid, &" << slot << ", ";
+    } else {
+      *out << "handle_read(";
+    }
+    *out << to_C_string(n.loc) << ", rule_name, " << to_C_string(n) << ", s, "
+      << lb << ", " << ub << ", ";
+  }
+
+  /* Note a read that may be reused, returning the name of the variable its
+   * value is kept in or "" if it is not to be cached.
+   */
+  std::string cached_read(const std::string &key) {
+    if (cache == nullptr)
+      return "";
+    if (!cache->emitting) {
+      cache->uses[key]++;
+      return "";
+    }
+    auto it = cache->slots.find(key);
+    if (it == cache->slots.end())
+      return "";
+    return "cse_" + std::to_string(it->second);
+  }
 };
 
 }
@@ -583,3 +789,40 @@ void generate_rvalue(std::ostream &out, const Expr &e) {
   Generator g(out, false);
   g.dispatch(e);
 }
+
+void generate_pure_rvalue(std::ostream &out, const Expr &e) {
+
+  if (!e.is_pure()) {
+    generate_rvalue(out, e);
+    return;
+  }
+
+  // first pass: count how many times each value is read
+  ReadCache cache;
+  {
+    std::ostringstream discard;
+    Generator g(discard, false, &cache);
+    g.dispatch(e);
+  }
+
+  for (const auto &u : cache.uses) {
+    if (u.second > 1) {
+      size_t slot = cache.slots.size();
+      cache.slots[u.first] = slot;
+    }
+  }
+
+  if (cache.slots.empty()) {
+    generate_rvalue(out, e);
+    return;
+  }
+
+  // second pass: emit storage for repeated reads, then the expression
+  cache.emitting = true;
+  out << "({ ";
+  for (size_t i = 0; i < cache.slots.size(); i++)
+    out << "value_t cse_" << i << " = 0; bool cse_" << i << "_valid = false; ";
+  Generator g(out, false, &cache);
+  g.dispatch(e);
+  out << "; })";
+}
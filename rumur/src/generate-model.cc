@@ -1,10 +1,16 @@
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include "../../common/escape.h"
 #include "generate.h"
 #include <gmpxx.h>
 #include <iostream>
 #include <memory>
+#include "options.h"
+#include "rule-profile.h"
 #include <rumur/rumur.h>
+#include <set>
+#include "state-accesses.h"
 #include <string>
 #include "symmetry-reduction.h"
 #include "utils.h"
@@ -18,6 +24,292 @@ static std::string rule_name_string(const Rule &r, size_t index) {
   return "\\\"" + escape(r.name) + "\\\"";
 }
 
+namespace {
+
+/* The leading conjunct of a rule's guard, when it is a comparison of an array
+ * element indexed by one of the rule's quantifiers against a constant (e.g.
+ * `q[i].state = Idle`).
+ */
+struct IndexFilter {
+  std::string quantifier; // name of the quantifier indexing the array
+  mpz_class base; // bit offset of the element for the quantifier's first value
+  mpz_class stride; // distance in bits between successive elements
+  mpz_class width; // width in bits of each element
+  mpz_class expected; // encoded value of the constant
+  mpz_class count; // number of values the quantifier takes
+};
+
+}
+
+/* Recognise a rule whose guard has a leading conjunct of the form described
+ * above. Only the first conjunct is evaluated unconditionally, so only it can
+ * be relied on not to be preceded by something that would have raised an
+ * error.
+ */
+static bool get_index_filter(const SimpleRule &r, IndexFilter &f) {
+
+  if (r.guard == nullptr)
+    return false;
+
+  const Expr *e = r.guard.get();
+  while (auto a = dynamic_cast<const And*>(e))
+    e = a->lhs.get();
+
+  auto eq = dynamic_cast<const Eq*>(e);
+  if (eq == nullptr)
+    return false;
+
+  for (const Expr *lhs : { eq->lhs.get(), eq->rhs.get() }) {
+    const Expr *rhs = lhs == eq->lhs.get() ? eq->rhs.get() : eq->lhs.get();
+    if (!rhs->constant())
+      continue;
+
+    const Ptr<TypeExpr> t = lhs->type()->resolve();
+    if (!t->is_simple() || t->width() > 64)
+      continue;
+
+    for (const Quantifier &q : r.quantifiers) {
+      mpz_class base, stride;
+      if (!get_quantified_state_offset(*lhs, q, base, stride))
+        continue;
+
+      // determine how the constant is encoded in the state
+      mpz_class min, max;
+      if (auto range = dynamic_cast<const Range*>(t.get())) {
+        min = range->min->constant_fold();
+        max = range->max->constant_fold();
+      } else if (auto en = dynamic_cast<const Enum*>(t.get())) {
+        min = 0;
+        max = en->count() - 2;
+      } else if (auto sc = dynamic_cast<const Scalarset*>(t.get())) {
+        min = 0;
+        max = sc->bound->constant_fold() - 1;
+      } else {
+        continue;
+      }
+      const mpz_class value = rhs->constant_fold();
+      if (value < min || value > max)
+        continue;
+
+      f.quantifier = q.name;
+      f.base = base;
+      f.stride = stride;
+      f.width = t->width();
+      f.expected = value - min + 1;
+      // exclude the extra value types count for representing undefined
+      f.count = q.type->count() - 1;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Generate code to evaluate an index filter against every element of the array
+ * slice it covers at once, before entering a rule's quantifier loops. The
+ * result is tested per quantifier value with the condition from
+ * index_filter_test(). This lets the generated code skip indices for which the
+ * guard is certain to be false without duplicating the state or calling the
+ * guard.
+ */
+static void generate_index_scan(std::ostream &out, const IndexFilter &f) {
+  out
+    << "      uint8_t may_hold[BITS_TO_BYTES(" << f.count << "ul)];\n"
+    << "      state_scan_may_equal(s, " << f.base << "ull, " << f.stride
+      << "ull, " << f.width << "ull, " << f.expected << "ull, " << f.count
+      << "ul, may_hold);\n";
+}
+
+static std::string index_filter_test(const IndexFilter &f) {
+  return "bitmap_get(may_hold, (size_t)_ru1_" + f.quantifier + " - 1)";
+}
+
+namespace {
+
+// a rule as it is tried within explore()
+struct RuleSlot {
+  const SimpleRule *rule;
+  size_t index; // position among the model's rules
+  mpz_class base; // value of rule_taken for the rule's first instance
+  const RuleProfile *profile; // statistics from --rule-profile, if any
+};
+
+}
+
+/* Determine the order in which explore() tries rules. This is declaration order
+ * unless a rule profile was loaded, in which case rules whose guards held most
+ * often during profiling come first.
+ */
+static std::vector<RuleSlot> rule_order(
+    const std::vector<Ptr<Rule>> &flat_rules) {
+
+  std::vector<RuleSlot> order;
+  size_t index = 0;
+  mpz_class base = 1;
+  for (const Ptr<Rule> &r : flat_rules) {
+    if (auto s = dynamic_cast<const SimpleRule*>(r.get())) {
+      const RuleProfile *p = options.rule_profile
+        ? get_rule_profile(rule_profile_key(*s, index)) : nullptr;
+      order.push_back(RuleSlot{s, index, base, p});
+
+      mpz_class instances = 1;
+      for (const Quantifier &q : s->quantifiers)
+        instances *= q.count();
+      base += instances;
+      index++;
+    }
+  }
+
+  if (options.rule_profile) {
+    // rules missing from the profile sort last
+    auto rate = [](const RuleSlot &slot) {
+      if (slot.profile == nullptr)
+        return -1.0;
+      if (slot.profile->evaluated == 0)
+        return 0.0;
+      return double(slot.profile->enabled) / double(slot.profile->evaluated);
+    };
+    std::stable_sort(order.begin(), order.end(),
+      [&](const RuleSlot &a, const RuleSlot &b) { return rate(a) > rate(b); });
+  }
+
+  return order;
+}
+
+/* Wrap a condition in a branch prediction hint if a profile shows it to be
+ * almost always or almost never true.
+ */
+static std::string expect(const std::string &cond, uint64_t taken,
+    uint64_t total) {
+  if (total > 0) {
+    if (taken >= total - total / 10)
+      return "__builtin_expect(" + cond + ", 1)";
+    if (taken <= total / 10)
+      return "__builtin_expect(" + cond + ", 0)";
+  }
+  return cond;
+}
+
+/* Write the per-instance breakdown for a quantified rule's entry in the
+ * --rule-statistics report.
+ */
+static void generate_rule_instances(std::ostream &out, const SimpleRule &r,
+    size_t index, const mpz_class &base) {
+
+  mpz_class instances = 1;
+  for (const Quantifier &q : r.quantifiers)
+    instances *= q.count();
+
+  out
+    << "static void print_rule_statistics" << index << "(void) {\n"
+    << "  for (uint64_t i = 0; i < UINT64_C(" << instances << "); i++) {\n"
+    << "    const struct rule_statistics st = rule_statistics_sum("
+      << (base - 1) << " + i, 1);\n"
+    << "    if (MACHINE_READABLE_OUTPUT) {\n"
+    << "      put(\"<instance\");\n"
+    << "      rule_statistics_put(&st);\n"
+    << "      put(\">\");\n"
+    << "    } else {\n"
+    << "      put(\"\\t\\t\");\n"
+    << "    }\n";
+
+  /* Decompose the instance number into quantifier values. The first quantifier
+   * varies slowest, as in explore().
+   */
+  mpz_class stride = instances;
+  bool first = true;
+  for (const Quantifier &q : r.quantifiers) {
+    stride /= q.count();
+    out
+      << "    {\n"
+      << "      const value_t v = (value_t)(i / UINT64_C(" << stride << ") % "
+        << q.count() << ") + VALUE_C(" << q.lower_bound() << ");\n"
+      << "      if (MACHINE_READABLE_OUTPUT) {\n"
+      << "        put(\"<parameter name=\\\"\");\n"
+      << "        xml_printf(\"" << q.name << "\");\n"
+      << "        put(\"\\\">\");\n"
+      << "      } else {\n"
+      << "        put(\"" << (first ? "" : ", ") << q.name << ": \");\n"
+      << "      }\n";
+
+    const Ptr<TypeExpr> t = q.type->resolve();
+    if (auto e = dynamic_cast<const Enum*>(t.get())) {
+      size_t member_index = 0;
+      for (const std::pair<std::string, location> &member : e->members) {
+        out << "      ";
+        if (member_index > 0)
+          out << "else ";
+        out << "if (v == VALUE_C(" << member_index << ")) {\n"
+          << "        if (MACHINE_READABLE_OUTPUT) {\n"
+          << "          xml_printf(\"" << member.first << "\");\n"
+          << "        } else {\n"
+          << "          put(\"" << member.first << "\");\n"
+          << "        }\n"
+          << "      }\n";
+        member_index++;
+      }
+    } else {
+      out << "      put_val(v);\n";
+    }
+
+    out
+      << "      if (MACHINE_READABLE_OUTPUT) {\n"
+      << "        put(\"</parameter>\");\n"
+      << "      }\n"
+      << "    }\n";
+    first = false;
+  }
+
+  out
+    << "    if (MACHINE_READABLE_OUTPUT) {\n"
+    << "      put(\"</instance>\\n\");\n"
+    << "    } else {\n"
+    << "      put(\": \");\n"
+    << "      rule_statistics_put(&st);\n"
+    << "      put(\"\\n\");\n"
+    << "    }\n"
+    << "  }\n"
+    << "}\n\n";
+}
+
+// Write the function that prints the --rule-statistics report.
+static void generate_rule_statistics(std::ostream &out,
+    const std::vector<Ptr<Rule>> &flat_rules) {
+
+  out << "#if RULE_STATISTICS > 0\n";
+
+  std::vector<RuleSlot> rules = rule_order(flat_rules);
+  std::sort(rules.begin(), rules.end(),
+    [](const RuleSlot &a, const RuleSlot &b) { return a.index < b.index; });
+
+  for (const RuleSlot &slot : rules) {
+    if (!slot.rule->quantifiers.empty())
+      generate_rule_instances(out, *slot.rule, slot.index, slot.base);
+  }
+
+  out
+    << "static void print_rule_statistics(void) {\n"
+    << "  struct rule_statistics_rule rules[] = {\n";
+  for (const RuleSlot &slot : rules) {
+    mpz_class instances = 1;
+    for (const Quantifier &q : slot.rule->quantifiers)
+      instances *= q.count();
+    out << "    { \"" << rule_name_string(*slot.rule, slot.index) << "\", "
+      << (slot.base - 1) << ", " << instances << ", ";
+    if (slot.rule->quantifiers.empty()) {
+      out << "NULL";
+    } else {
+      out << "print_rule_statistics" << slot.index;
+    }
+    out << ", { 0 } },\n";
+  }
+  out
+    << "  };\n"
+    << "  rule_statistics_report(rules, sizeof(rules) / sizeof(rules[0]));\n"
+    << "}\n"
+    << "#endif\n\n";
+}
+
 void generate_model(std::ostream &out, const Model &m) {
 
   // Write out the symmetry reduction canonicalisation function
@@ -61,14 +353,6 @@ void generate_model(std::ostream &out, const Model &m) {
         out << "  static const char *rule_name __attribute__((unused)) = \"startstate "
           << rule_name_string(*s, index) << "\";\n";
 
-        out
-          << "  if (JMP_BUF_NEEDED) {\n"
-          << "    if (sigsetjmp(checkpoint, 0)) {\n"
-          << "      /* error triggered during this startstate */\n"
-          << "      return false;\n"
-          << "    }\n"
-          << "  }\n";
-
         /* Output the state variable handles so we can reference them within
          * this start state.
          */
@@ -183,14 +467,6 @@ void generate_model(std::ostream &out, const Model &m) {
         out << "  static const char *rule_name __attribute__((unused)) = \""
           << "guard of rule " << rule_name_string(*s, index) << "\";\n";
 
-        out
-          << "  if (JMP_BUF_NEEDED) {\n"
-          << "    if (sigsetjmp(checkpoint, 0)) {\n"
-          << "      /* this guard triggered an error */\n"
-          << "      return -1;\n"
-          << "    }\n"
-          << "  }\n";
-
         /* Output the state variable handles so we can reference them within
          * this guard.
          */
@@ -215,7 +491,7 @@ void generate_model(std::ostream &out, const Model &m) {
         if (s->guard == nullptr) {
           out << "true";
         } else {
-          generate_rvalue(out, *s->guard);
+          generate_pure_rvalue(out, *s->guard);
         }
         out << " ? 1 : 0;\n"
           << std::string(s->aliases.size(), '}') << "\n"
@@ -230,14 +506,6 @@ void generate_model(std::ostream &out, const Model &m) {
         out << "  static const char *rule_name __attribute__((unused)) = \"rule "
           << rule_name_string(*s, index) << "\";\n";
 
-        out
-          << "  if (JMP_BUF_NEEDED) {\n"
-          << "    if (sigsetjmp(checkpoint, 0)) {\n"
-          << "      /* an error was triggered during this rule */\n"
-          << "      return false;\n"
-          << "    }\n"
-          << "  }\n";
-
         /* Output the state variable handles so we can reference them within
          * this rule.
          */
@@ -297,13 +565,7 @@ void generate_model(std::ostream &out, const Model &m) {
     out
       << "static bool check_invariants(const struct state *NONNULL s "
         << "__attribute__((unused))) {\n"
-      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
-      << "  if (JMP_BUF_NEEDED) {\n"
-      << "    if (sigsetjmp(checkpoint, 0)) {\n"
-      << "      /* invariant violated */\n"
-      << "      return false;\n"
-      << "    }\n"
-      << "  }\n";
+      << "  static const char *rule_name __attribute__((unused)) = NULL;\n";
     size_t index = 0;
     size_t invariant_index = 0;
     for (const Ptr<Rule> &r : flat_rules) {
@@ -347,13 +609,7 @@ void generate_model(std::ostream &out, const Model &m) {
     out
       << "static bool check_assumptions(const struct state *NONNULL s "
         << "__attribute__((unused))) {\n"
-      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
-      << "  if (JMP_BUF_NEEDED) {\n"
-      << "    if (sigsetjmp(checkpoint, 0)) {\n"
-      << "      /* one of the properties triggered an error */\n"
-      << "      return false;\n"
-      << "    }\n"
-      << "  }\n";
+      << "  static const char *rule_name __attribute__((unused)) = NULL;\n";
     size_t index = 0;
     for (const Ptr<Rule> &r : flat_rules) {
       if (auto p = dynamic_cast<const PropertyRule*>(r.get())) {
@@ -395,13 +651,7 @@ void generate_model(std::ostream &out, const Model &m) {
     out
       << "static bool check_covers(const struct state *NONNULL s "
         << "__attribute__((unused))) {\n"
-      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
-      << "  if (JMP_BUF_NEEDED) {\n"
-      << "    if (sigsetjmp(checkpoint, 0)) {\n"
-      << "      /* one of the properties triggered an error */\n"
-      << "      return false;\n"
-      << "    }\n"
-      << "  }\n";
+      << "  static const char *rule_name __attribute__((unused)) = NULL;\n";
     size_t index = 0;
     for (const Ptr<Rule> &r : flat_rules) {
       if (auto p = dynamic_cast<const PropertyRule*>(r.get())) {
@@ -446,13 +696,9 @@ void generate_model(std::ostream &out, const Model &m) {
       << "static bool check_liveness(struct state *NONNULL s "
         << "__attribute__((unused))) {\n"
       << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
-      << "  if (JMP_BUF_NEEDED) {\n"
-      << "    if (sigsetjmp(checkpoint, 0)) {\n"
-      << "      /* one of the liveness properties triggered an error */\n"
-      << "      return false;\n"
-      << "    }\n"
-      << "  }\n"
-      << "  size_t liveness_index __attribute__((unused)) = 0;\n";
+      << "  size_t liveness_index __attribute__((unused)) = 0;\n"
+      << "  /* properties hit, collected to be marked a word at a time */\n"
+      << "  uintptr_t hit[sizeof(s->liveness) / sizeof(s->liveness[0])] = { 0 };\n";
     size_t index = 0;
     for (const Ptr<Rule> &r : flat_rules) {
       if (auto p = dynamic_cast<const PropertyRule*>(r.get())) {
@@ -470,7 +716,8 @@ void generate_model(std::ostream &out, const Model &m) {
             out << ", ru_" << q.name;
           out << ")) {\n"
             << "      /* Hit. */\n"
-            << "      mark_liveness(s, liveness_index, false);\n"
+            << "      hit[liveness_index / (sizeof(hit[0]) * CHAR_BIT)] |=\n"
+            << "        (uintptr_t)1 << (liveness_index % (sizeof(hit[0]) * CHAR_BIT));\n"
             << "    }\n"
             << "    liveness_index++;\n";
 
@@ -486,176 +733,102 @@ void generate_model(std::ostream &out, const Model &m) {
       }
     }
     out
+      << "  for (size_t i = 0; i < sizeof(hit) / sizeof(hit[0]); i++) {\n"
+      << "    if (hit[i] != 0) {\n"
+      << "      mark_liveness(s, i, hit[i], false);\n"
+      << "    }\n"
+      << "  }\n"
       << "  return true;\n"
       << "}\n\n";
   }
 
-  // Write final liveness checker, the one that runs just prior to termination
+  // Write the expansion used by the final liveness check
   {
     out
-      << "static void check_liveness_final(void) {\n"
+      << "static void liveness_expand(const struct state *NONNULL s, size_t index,\n"
+      << "    struct liveness_edges *NONNULL edges) {\n"
       << "\n"
       << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
-      << "\n"
-      << "  if (!MACHINE_READABLE_OUTPUT) {\n"
-      << "    put(\"trying to prove remaining liveness constraints...\\n\");\n"
-      << "  }\n"
-      << "\n"
-      << "  /* find how many liveness bits are unknown */\n"
-      << "  unsigned long remaining = 0;\n"
-      << "  unsigned long long last_update = 0;\n"
-      << "  unsigned long learned_since_last = 0;\n"
-      << "  if (!MACHINE_READABLE_OUTPUT) {\n"
-      << "    for (size_t i = 0; i < set_size(local_seen); i++) {\n"
-      << "\n"
-      << "      slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);\n"
-      << "\n"
-      << "      ASSERT(!slot_is_tombstone(slot)\n"
-      << "        && \"seen set being migrated during final liveness check\");\n"
-      << "\n"
-      << "      if (slot_is_empty(slot)) {\n"
-      << "        /* skip empty entries in the hash table */\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "\n"
-      << "      struct state *s = slot_to_state(slot);\n"
-      << "      ASSERT(s != NULL && \"null pointer stored in state set\");\n"
-      << "\n"
-      << "      remaining += unknown_liveness(s);\n"
-      << "    }\n"
-      << "    put(\"\\t \");\n"
-      << "    put_uint(remaining);\n"
-      << "    put(\" constraints remaining\\n\");\n"
-      << "    last_update = gettime();\n"
-      << "  }\n"
-      << "\n"
-      << "  bool progress = true;\n"
-      << "  while (progress) {\n"
-      << "    progress = false;\n"
-      << "\n"
-      << "    /* Run through all seen states trying to learn new liveness information. */\n"
-      << "    for (size_t i = 0; i < set_size(local_seen); i++) {\n"
-      << "\n"
-      << "      slot_t slot = __atomic_load_n(&local_seen->bucket[i], __ATOMIC_SEQ_CST);\n"
-      << "\n"
-      << "      ASSERT(!slot_is_tombstone(slot)\n"
-      << "        && \"seen set being migrated during final liveness check\");\n"
-      << "\n"
-      << "      if (slot_is_empty(slot)) {\n"
-      << "        /* skip empty entries in the hash table */\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "\n"
-      << "      struct state *s = slot_to_state(slot);\n"
-      << "      ASSERT(s != NULL && \"null pointer stored in state set\");\n"
-      << "\n"
-      << "      if (unknown_liveness(s) == 0) {\n"
-      << "        /* skip entries where liveness is fully satisfied already */\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "\n"
-      << "#if BOUND > 0\n"
-      << "      /* If we're doing bounded checking and this state is at the bound limit,\n"
-      << "       * it's not valid to expand beyond this.\n"
-      << "       */\n"
-      << "      ASSERT(state_bound_get(s) <= BOUND && \"a state that exceeded the bound depth was explored\");\n"
-      << "      if (state_bound_get(s) == BOUND) {\n"
-      << "        continue;\n"
-      << "      }\n"
-      << "#endif\n"
+      << "  uint64_t rule_taken __attribute__((unused)) = 1;\n"
       << "\n";
     size_t index = 0;
     for (const Ptr<Rule> &r : flat_rules) {
       if (isa<SimpleRule>(r)) {
 
         // Open a scope so we don't have to think about name collisions.
-        out << "      {\n";
+        out << "  {\n";
 
         for (const Quantifier &q : r->quantifiers)
           generate_quantifier_header(out, q);
 
         out
           // Use a dummy do-while to give us 'break' as a local goto.
-          << "        do {\n"
-          << "          struct state *n = state_dup(s);\n"
+          << "    do {\n"
+          << "      struct state *n = state_dup(s);\n"
+          << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+          << "      state_rule_taken_set(n, rule_taken);\n"
+          << "#endif\n"
           << "\n"
-          << "          int g = guard" << index << "(n";
+          << "      int g = CHECKPOINTED(guard" << index << "(n";
         for (const Quantifier &q : r->quantifiers)
           out << ", ru_" << q.name;
-        out << ");\n"
-          << "          if (g == -1) {\n"
-          << "            /* guard triggered an error */\n"
-          << "            state_free(n);\n"
-          << "            break;\n"
-          << "          } else if (g == 1) {\n"
-          << "            if (!rule" << index << "(n";
+        out << "), -1);\n"
+          << "      if (g == -1) {\n"
+          << "        /* guard triggered an error */\n"
+          << "        state_free(n);\n"
+          << "        break;\n"
+          << "      } else if (g == 1) {\n"
+          << "        if (!CHECKPOINTED(rule" << index << "(n";
         for (const Quantifier &q : r->quantifiers)
           out << ", ru_" << q.name;
-        out << ")) {\n"
-          << "              /* this rule triggered an error */\n"
-          << "              state_free(n);\n"
-          << "              break;\n"
-          << "            }\n"
-          << "            state_canonicalise(n);\n"
-          << "            if (!check_assumptions(n)) {\n"
-          << "              /* assumption violated */\n"
-          << "              state_free(n);\n"
-          << "              break;\n"
-          << "            }\n"
+        out << "), false)) {\n"
+          << "          /* this rule triggered an error */\n"
+          << "          state_free(n);\n"
+          << "          break;\n"
+          << "        }\n"
+          << "        state_canonicalise(n);\n"
+          << "        if (!CHECKPOINTED(check_assumptions(n), false)) {\n"
+          << "          /* assumption violated */\n"
+          << "          state_free(n);\n"
+          << "          break;\n"
+          << "        }\n"
           << "\n"
-          << "            /* note that we can skip an invariant check because we already know it\n"
-          << "             * passed from prior expansion of this state.\n"
-          << "             */\n"
+          << "        /* note that we can skip an invariant check because we already know it\n"
+          << "         * passed from prior expansion of this state.\n"
+          << "         */\n"
           << "\n"
-          << "            /* We should be able to find this state in the seen set. */\n"
-          << "            const struct state *t = set_find(n);\n"
-          << "            ASSERT(t != NULL && \"state encountered during final liveness wrap up \"\n"
-          << "              \"that was not previously seen\");\n"
+          << "        /* We should be able to find this state in the seen set. */\n"
+          << "        size_t successor = set_find_index(n);\n"
+          << "        ASSERT(successor != SIZE_MAX && \"state encountered during final \"\n"
+          << "          \"liveness wrap up that was not previously seen\");\n"
           << "\n"
-          << "            /* See if this successor state learned a liveness property it never\n"
-          << "             * passed back to us. This can occur if the state our exploration\n"
-          << "             * encountered (`n`) was not the first of its kind seen and thus was\n"
-          << "             * de-duped and never made it into the seen set with a back pointer\n"
-          << "             * to `s`.\n"
-          << "             */\n"
-          << "            unsigned long learned = learn_liveness(s, t);\n"
-          << "            if (learned > 0) {\n"
-          << "              if (!MACHINE_READABLE_OUTPUT) {\n"
-          << "                learned_since_last += learned;\n"
-          << "                remaining -= learned;\n"
-          << "                unsigned long long t = gettime();\n"
-          << "                if (t > last_update) {\n"
-          << "                  put(\"\\t \");\n"
-          << "                  put_uint(learned_since_last);\n"
-          << "                  put(\" further liveness constraints proved in \");\n"
-          << "                  put_uint(t - last_update);\n"
-          << "                  put(\"s, with \");\n"
-          << "                  put(green()); put_uint(remaining); put(reset());\n"
-          << "                  put(\" remaining\\n\");\n"
-          << "                  learned_since_last = 0;\n"
-          << "                  last_update = t;\n"
-          << "                }\n"
-          << "              }\n"
-          << "              progress = true;\n"
-          << "            }\n"
-          << "          }\n"
-          << "          /* we don't need this state anymore. */\n"
-          << "          state_free(n);\n"
-          << "        } while (0);\n";
+          << "        /* Record the edge, through which this successor may pass back\n"
+          << "         * liveness properties it never passed to us. This can occur if the\n"
+          << "         * state our exploration encountered (`n`) was not the first of its\n"
+          << "         * kind seen and thus was de-duped and never made it into the seen\n"
+          << "         * set with a back pointer to `s`.\n"
+          << "         */\n"
+          << "        if (liveness_edges_append(edges, successor, index, n)) {\n"
+          << "          /* the edge list retained this state */\n"
+          << "          break;\n"
+          << "        }\n"
+          << "      }\n"
+          << "      /* we don't need this state anymore. */\n"
+          << "      state_free(n);\n"
+          << "    } while (0);\n"
+          << "    rule_taken++;\n";
 
         // Close the quantifier loops.
         for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
           generate_quantifier_footer(out, *it);
 
         // Close this rule's scope.
-        out << "}\n";
+        out << "  }\n";
 
         index++;
       }
     }
     out
-      << "    }\n"
-      << "  }\n"
       << "}\n"
       << "\n"
       << "\n"
@@ -711,7 +884,7 @@ void generate_model(std::ostream &out, const Model &m) {
               << " violated:\");\n"
             << "          put(reset()); put(\"\\n\");\n"
             << "        }\n"
-            << "        print_counterexample(s);\n"
+            << "        print_liveness_counterexample(s, i, word_index, bit_index);\n"
             << "        if (MACHINE_READABLE_OUTPUT) {\n"
             << "          put(\"</error>\\n\");\n"
             << "        }\n"
@@ -746,13 +919,137 @@ void generate_model(std::ostream &out, const Model &m) {
       << "\n";
   }
 
+  // Write a function to regenerate successors when reconstructing traces
+  {
+    out
+      << "#if TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+      << "static void replay_expand(const struct state *s, struct replay *NONNULL r) {\n"
+      << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
+      << "  uint64_t rule_taken = 1;\n"
+      << "\n"
+      << "  if (s == NULL) {\n";
+
+    size_t index = 0;
+    for (const Ptr<Rule> &r : flat_rules) {
+      if (isa<StartState>(r)) {
+
+        // Open a scope so we don't have to think about name collisions.
+        out << "  {\n";
+
+        for (const Quantifier &q : r->quantifiers)
+          generate_quantifier_header(out, q);
+
+        out
+          // Use a dummy do-while to give us 'break' as a local goto.
+          << "    do {\n"
+          << "      struct state *n = state_new();\n"
+          << "      memset(n, 0, sizeof(*n));\n"
+          << "      state_rule_taken_set(n, rule_taken);\n"
+          << "      if (!CHECKPOINTED(startstate" << index << "(n";
+        for (const Quantifier &q : r->quantifiers)
+          out << ", ru_" << q.name;
+        out << "), false)) {\n"
+          << "        state_free(n);\n"
+          << "        break;\n"
+          << "      }\n"
+          << "      state_canonicalise(n);\n"
+          << "      if (!CHECKPOINTED(check_assumptions(n), false)\n"
+          << "          || !CHECKPOINTED(check_invariants(n), false)) {\n"
+          << "        state_free(n);\n"
+          << "        break;\n"
+          << "      }\n"
+          << "      bool found = replay_visit(r, n);\n"
+          << "      state_free(n);\n"
+          << "      if (found) {\n"
+          << "        return;\n"
+          << "      }\n"
+          << "    } while (0);\n"
+          << "    rule_taken++;\n";
+
+        // Close the quantifier loops.
+        for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
+          generate_quantifier_footer(out, *it);
+
+        // Close this startstate's scope.
+        out << "  }\n";
+
+        index++;
+      }
+    }
+
+    out
+      << "    return;\n"
+      << "  }\n"
+      << "\n";
+
+    index = 0;
+    for (const Ptr<Rule> &r : flat_rules) {
+      if (isa<SimpleRule>(r)) {
+
+        // Open a scope so we don't have to think about name collisions.
+        out << "  {\n";
+
+        for (const Quantifier &q : r->quantifiers)
+          generate_quantifier_header(out, q);
+
+        out
+          // Use a dummy do-while to give us 'break' as a local goto.
+          << "    do {\n"
+          << "      struct state *n = state_dup(s);\n"
+          << "      state_rule_taken_set(n, rule_taken);\n"
+          << "      int g = CHECKPOINTED(guard" << index << "(n";
+        for (const Quantifier &q : r->quantifiers)
+          out << ", ru_" << q.name;
+        out << "), -1);\n"
+          << "      if (g != 1 || !CHECKPOINTED(rule" << index << "(n";
+        for (const Quantifier &q : r->quantifiers)
+          out << ", ru_" << q.name;
+        out << "), false)) {\n"
+          << "        /* guard was false or an error was triggered */\n"
+          << "        state_free(n);\n"
+          << "        break;\n"
+          << "      }\n"
+          << "      state_canonicalise(n);\n"
+          << "      if (!CHECKPOINTED(check_assumptions(n), false)\n"
+          << "          || !CHECKPOINTED(check_invariants(n), false)) {\n"
+          << "        state_free(n);\n"
+          << "        break;\n"
+          << "      }\n"
+          << "      bool found = replay_visit(r, n);\n"
+          << "      state_free(n);\n"
+          << "      if (found) {\n"
+          << "        return;\n"
+          << "      }\n"
+          << "    } while (0);\n"
+          << "    rule_taken++;\n";
+
+        // Close the quantifier loops.
+        for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
+          generate_quantifier_footer(out, *it);
+
+        // Close this rule's scope.
+        out << "  }\n";
+
+        index++;
+      }
+    }
+
+    out
+      << "}\n"
+      << "#endif\n"
+      << "\n";
+  }
+
   // Write initialisation
   {
     out
       << "static void init(void) {\n"
       << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
       << "  size_t queue_id = 0;\n"
-      << "  uint64_t rule_taken = 1;\n";
+      << "  uint64_t rule_taken = 1;\n"
+      << "#if TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+      << "  replay_initialising = true;\n"
+      << "#endif\n";
 
     size_t index = 0;
     for (const Ptr<Rule> &r : flat_rules) {
@@ -779,38 +1076,40 @@ void generate_model(std::ostream &out, const Model &m) {
           << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
           << "      state_rule_taken_set(s, rule_taken);\n"
           << "#endif\n"
-          << "      if (!startstate" << index << "(s";
+          << "      if (!CHECKPOINTED(startstate" << index << "(s";
         for (const Quantifier &q : r->quantifiers)
           out << ", ru_" << q.name;
-        out << ")) {\n"
+        out << "), false)) {\n"
           << "        /* startstate triggered an error */\n"
           << "        state_free(s);\n"
           << "        break;\n"
           << "      }\n"
           << "      state_canonicalise(s);\n"
-          << "      if (!check_assumptions(s)) {\n"
+          << "      if (!CHECKPOINTED(check_assumptions(s), false)) {\n"
           << "        /* assumption violated */\n"
           << "        state_free(s);\n"
           << "        break;\n"
           << "      }\n"
-          << "      if (!check_invariants(s)) {\n"
+          << "      if (!CHECKPOINTED(check_invariants(s), false)) {\n"
           << "        /* invariant violated */\n"
           << "        state_free(s);\n"
           << "        break;\n"
           << "      }\n"
           << "      size_t size;\n"
-          << "      if (set_insert(s, &size)) {\n"
-          << "        if (!check_covers(s)) {\n"
+          << "      if (set_insert(s, &size, NULL)) {\n"
+          << "        if (!CHECKPOINTED(check_covers(s), false)) {\n"
           << "          /* one of the cover properties triggered an error */\n"
           << "          break;\n"
           << "        }\n"
           << "#if LIVENESS_COUNT > 0\n"
-          << "        if (!check_liveness(s)) {\n"
+          << "        if (!CHECKPOINTED(check_liveness(s), false)) {\n"
           << "          /* one of the liveness properties triggered an error */\n"
           << "          break;\n"
           << "        }\n"
           << "#endif\n"
+          << "        work_enqueued();\n"
           << "        (void)queue_enqueue(s, queue_id);\n"
+          << "        idle_wake(1);\n"
           << "        queue_id = (queue_id + 1) % (sizeof(q) / sizeof(q[0]));\n"
           << "      } else {\n"
           << "        state_free(s);\n"
@@ -828,10 +1127,77 @@ void generate_model(std::ostream &out, const Model &m) {
         index++;
       }
     }
-    out << "}\n\n";
+    out
+      << "#if TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+      << "  replay_initialising = false;\n"
+      << "#endif\n"
+      << "  work_finished();\n"
+      << "}\n\n";
   }
 
   // Write exploration logic
+  /* Write the tables the guard cache uses: the first rule instance (index
+   * into a state's guard bitmaps) of each rule and, for each pair of rules,
+   * whether firing the first can change the result of the second's guard.
+   */
+  {
+    std::vector<const SimpleRule*> rules;
+    for (const Ptr<Rule> &r : flat_rules) {
+      if (auto s = dynamic_cast<const SimpleRule*>(r.get()))
+        rules.push_back(s);
+    }
+
+    std::vector<std::set<std::string>> writes;
+    std::vector<std::set<std::string>> reads;
+    for (const SimpleRule *s : rules) {
+      std::set<std::string> w;
+      for (const Ptr<Stmt> &st : s->body) {
+        std::set<std::string> a = state_accesses(*st);
+        w.insert(a.begin(), a.end());
+      }
+      writes.push_back(w);
+      reads.push_back(s->guard == nullptr ? std::set<std::string>()
+        : state_accesses(*s->guard));
+    }
+
+    out
+      << "#if GUARD_CACHE_BITS > 0\n"
+      << "enum { GUARD_RULES = " << rules.size() << "ul };\n\n"
+      << "static const size_t GUARD_START[GUARD_RULES + 1] = {";
+    mpz_class start = 0;
+    for (const SimpleRule *s : rules) {
+      out << " " << start << "ul,";
+      mpz_class count = 1;
+      for (const Quantifier &q : s->quantifiers)
+        count *= q.count();
+      start += count;
+    }
+    out << " " << start << "ul };\n\n"
+      << "static const uint8_t GUARD_UNAFFECTED[GUARD_RULES]"
+        << "[BITS_TO_BYTES(GUARD_RULES)] = {\n";
+    for (size_t i = 0; i < rules.size(); i++) {
+      out << "  {";
+      for (size_t byte = 0; byte * 8 < rules.size(); byte++) {
+        unsigned value = 0;
+        for (size_t j = byte * 8; j < rules.size() && j < byte * 8 + 8; j++) {
+          bool unaffected = true;
+          for (const std::string &v : reads[j]) {
+            if (writes[i].count(v) > 0) {
+              unaffected = false;
+              break;
+            }
+          }
+          if (unaffected)
+            value |= 1u << (j % 8);
+        }
+        out << " " << value << ",";
+      }
+      out << " },\n";
+    }
+    out << "};\n"
+      << "#endif\n\n";
+  }
+
   {
     out
       << "static void explore(void) {\n"
@@ -839,170 +1205,361 @@ void generate_model(std::ostream &out, const Model &m) {
       << "  /* Used when writing to quantifier variables. */\n"
       << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
       << "\n"
-      << "  size_t last_queue_size = 0;\n"
+      << "  /* The locals below are static so they survive unwinding to the\n"
+      << "   * checkpoint.\n"
+      << "   */\n"
+      << "  static _Thread_local size_t last_queue_size;\n"
+      << "  last_queue_size = 0;\n"
       << "\n"
       << "  /* Identifier of the last queue we interacted with. */\n"
-      << "  size_t queue_id = thread_id;\n"
+      << "  static _Thread_local size_t queue_id;\n"
+      << "  queue_id = thread_id;\n"
+      << "\n"
+      << "  if (JMP_BUF_NEEDED) {\n"
+      << "    if (sigsetjmp(checkpoint, 0)) {\n"
+      << "      /* an error or failed assumption interrupted expanding a state */\n"
+      << "      expansion_resume();\n"
+      << "    }\n"
+      << "  }\n"
       << "\n"
       << "  for (;;) {\n"
       << "\n"
-      << "    if (THREADS > 1 && __atomic_load_n(&error_count,\n"
-      << "        __ATOMIC_SEQ_CST) >= MAX_ERRORS) {\n"
-      << "      /* Another thread found an error. */\n"
-      << "      break;\n"
-      << "    }\n"
+      << "    if (expansion.state == NULL) {\n"
+      << "\n"
+      << "      if (THREADS > 1 && __atomic_load_n(&error_count,\n"
+      << "          __ATOMIC_SEQ_CST) >= MAX_ERRORS) {\n"
+      << "        /* Another thread found an error. */\n"
+      << "        break;\n"
+      << "      }\n"
       << "\n"
-      << "    const struct state *s = queue_dequeue(&queue_id);\n"
-      << "    if (s == NULL) {\n"
-      << "      break;\n"
+      << "      const struct state *next = queue_next(&queue_id);\n"
+      << "      if (next == NULL) {\n"
+      << "        break;\n"
+      << "      }\n"
+      << "      expansion_begin(next);\n"
       << "    }\n"
+      << "    const struct state *s = expansion.state;\n"
+      << "#if TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+      << "    replay_expanding = s;\n"
+      << "#endif\n"
       << "\n"
-      << "    bool possible_deadlock = true;\n"
-      << "    uint64_t rule_taken = 1;\n";
-    size_t index = 0;
-    for (const Ptr<Rule> &r : flat_rules) {
-      if (isa<SimpleRule>(r)) {
+      << "#if GUARD_CACHE_BITS > 0\n"
+      << "    /* Evaluate any guards whose results were not inherited from this\n"
+      << "     * state's predecessor, so the full set of results is available to\n"
+      << "     * pass on to its successors. The results are static so they survive\n"
+      << "     * resuming this expansion.\n"
+      << "     */\n"
+      << "    static _Thread_local uint8_t guards_known[BITS_TO_BYTES(GUARD_CACHE_BITS)];\n"
+      << "    static _Thread_local uint8_t guards_enabled[BITS_TO_BYTES(GUARD_CACHE_BITS)];\n"
+      << "    static _Thread_local uint8_t guards_failed[BITS_TO_BYTES(GUARD_CACHE_BITS)];\n"
+      << "    if (expansion.done == 0) {\n"
+      << "      memcpy(guards_known, s->guards_known, sizeof(guards_known));\n"
+      << "      memcpy(guards_enabled, s->guards_enabled, sizeof(guards_enabled));\n"
+      << "      memset(guards_failed, 0, sizeof(guards_failed));\n"
+      << "    }\n"
+      << "    {\n"
+      << "      size_t guard_index = 0;\n";
+    {
+      size_t index = 0;
+      for (const Ptr<Rule> &r : flat_rules) {
+        if (isa<SimpleRule>(r)) {
 
-        // Open a scope so we don't have to think about name collisions.
-        out << "    {\n";
+          out << "    {\n";
 
-        for (const Quantifier &q : r->quantifiers)
-          generate_quantifier_header(out, q);
+          IndexFilter filter;
+          bool filtered
+            = get_index_filter(dynamic_cast<const SimpleRule&>(*r), filter);
+          if (filtered)
+            generate_index_scan(out, filter);
 
-        out
-          // Use a dummy do-while to give us 'break' as a local goto.
-          << "      do {\n"
-          << "        struct state *n = state_dup(s);\n"
-          << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
-          << "        state_rule_taken_set(n, rule_taken);\n"
-          << "#endif\n"
-          << "        int g = guard" << index << "(n";
-        for (const Quantifier &q : r->quantifiers)
-          out << ", ru_" << q.name;
-        out << ");\n"
-          << "        if (g == -1) {\n"
-          << "          /* error() was called */\n"
-          << "          state_free(n);\n"
-          << "          break;\n"
-          << "        } else if (g == 1) {\n"
-          << "          if (!rule" << index << "(n";
-        for (const Quantifier &q : r->quantifiers)
-          out << ", ru_" << q.name;
-        out << ")) {\n"
-          << "            /* this rule triggered an error */\n"
-          << "            state_free(n);\n"
-          << "            break;\n"
-          << "          }\n"
-          << "          rules_fired_local++;\n"
-          << "          if (DEADLOCK_DETECTION != DEADLOCK_DETECTION_STUTTERING || !state_eq(s, n)) {\n"
-          << "            possible_deadlock = false;\n"
-          << "          }\n"
-          << "          state_canonicalise(n);\n"
-          << "          if (!check_assumptions(n)) {\n"
-          << "            /* assumption violated */\n"
-          << "            state_free(n);\n"
-          << "            break;\n"
-          << "          }\n"
-          << "          if (!check_invariants(n)) {\n"
-          << "            /* invariant violated */\n"
-          << "            state_free(n);\n"
-          << "            break;\n"
-          << "          }\n"
-          << "          size_t size;\n"
-          << "          if (set_insert(n, &size)) {\n"
-          << "\n"
-          << "            if (!check_covers(n)) {\n"
-          << "              /* one of the cover properties triggered an error */\n"
-          << "              break;\n"
-          << "            }\n"
-          << "#if LIVENESS_COUNT > 0\n"
-          << "            if (!check_liveness(n)) {\n"
-          << "              /* one of the liveness properties triggered an error */\n"
-          << "              break;\n"
-          << "            }\n"
-          << "#endif\n"
-          << "\n"
-          << "#if BOUND > 0\n"
-          << "            if (state_bound_get(n) < BOUND) {\n"
-          << "#endif\n"
-          << "            size_t queue_size = queue_enqueue(n, thread_id);\n"
-          << "            queue_id = thread_id;\n"
-          << "\n"
-          << "            if (size % 10000 == 0 && ftrylockfile(stdout) == 0) {\n"
-          << "              if (MACHINE_READABLE_OUTPUT) {\n"
-          << "                put(\"<progress states=\\\"\");\n"
-          << "                put_uint(size);\n"
-          << "                put(\"\\\" duration_seconds=\\\"\");\n"
-          << "                put_uint(gettime());\n"
-          << "                put(\"\\\" rules_fired=\\\"\");\n"
-          << "                put_uint(rules_fired_local);\n"
-          << "                put(\"\\\" queue_size=\\\"\");\n"
-          << "                put_uint(queue_size);\n"
-          << "                put(\"\\\" thread_id=\\\"\");\n"
-          << "                put_uint(thread_id);\n"
-          << "                put(\"\\\"/>\\n\");\n"
-          << "              } else {\n"
-          << "                put(\"\\t \");\n"
-          << "                if (THREADS > 1) {\n"
-          << "                  put(\"thread \");\n"
-          << "                  put_uint(thread_id);\n"
-          << "                  put(\": \");\n"
-          << "                }\n"
-          << "                put_uint(size);\n"
-          << "                put(\" states explored in \");\n"
-          << "                put_uint(gettime());\n"
-          << "                put(\"s, with \");\n"
-          << "                put_uint(rules_fired_local);\n"
-          << "                put(\" rules fired and \");\n"
-          << "                put(queue_size > last_queue_size ? yellow() : green());\n"
-          << "                put_uint(queue_size);\n"
-          << "                put(reset());\n"
-          << "                put(\" states in the queue.\\n\");\n"
-          << "              }\n"
-          << "              funlockfile(stdout);\n"
-          << "              last_queue_size = queue_size;\n"
-          << "            }\n"
-          << "\n"
-          << "            if (THREADS > 1 && thread_id == 0 && phase == WARMUP && queue_size > 20) {\n"
-          << "              start_secondary_threads();\n"
-          << "              phase = RUN;\n"
-          << "            }\n"
-          << "\n"
-          << "#if BOUND > 0\n"
-          << "            }\n"
-          << "#endif\n"
-          << "          } else {\n"
-          << "            state_free(n);\n"
-          << "          }\n"
-          << "        } else {\n"
-          << "          state_free(n);\n"
-          << "        }\n"
-          << "      } while (0);\n"
-          << "      rule_taken++;\n";
+          for (const Quantifier &q : r->quantifiers)
+            generate_quantifier_header(out, q);
 
-        // Close the quantifier loops.
-        for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
-          generate_quantifier_footer(out, *it);
+          if (filtered) {
+            out
+              << "      if (!bitmap_get(guards_known, guard_index) && !"
+                << index_filter_test(filter) << ") {\n"
+              << "        bitmap_set(guards_known, guard_index, true);\n"
+              << "        bitmap_set(guards_enabled, guard_index, false);\n"
+              << "      }\n";
+          }
 
-        // Close this rule's scope.
-        out << "}\n";
+          out
+            << "      if ((!JMP_BUF_NEEDED || ++expansion.step > expansion.done)\n"
+            << "          && !bitmap_get(guards_known, guard_index)) {\n"
+            << "        struct state *n = state_dup(s);\n"
+            << "        expansion.successor = n;\n"
+            << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+            << "        state_rule_taken_set(n, guard_index + 1);\n"
+            << "#endif\n"
+            << "        /* considered failed unless evaluation completes */\n"
+            << "        bitmap_set(guards_failed, guard_index, true);\n"
+            << "#if RULE_STATISTICS > 0\n"
+            << "        rule_statistics_local[guard_index].guards++;\n"
+            << "#endif\n"
+            << "        int g = guard" << index << "(n";
+          for (const Quantifier &q : r->quantifiers)
+            out << ", ru_" << q.name;
+          out << ");\n"
+            << "        state_free(n);\n"
+            << "        bitmap_set(guards_failed, guard_index, false);\n"
+            << "        bitmap_set(guards_known, guard_index, true);\n"
+            << "        bitmap_set(guards_enabled, guard_index, g == 1);\n"
+            << "      }\n"
+            << "      guard_index++;\n";
 
-        index++;
+          for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
+            generate_quantifier_footer(out, *it);
+
+          out << "}\n";
+
+          index++;
+        }
       }
     }
+    out
+      << "    }\n"
+      << "#endif\n"
+      << "\n"
+      << "    uint64_t rule_taken = 1;\n";
+    for (const RuleSlot &slot : rule_order(flat_rules)) {
+      const SimpleRule *r = slot.rule;
+      const size_t index = slot.index;
+
+      // Open a scope so we don't have to think about name collisions.
+      out << "    {\n";
+
+      // rules may be out of order, so each sets its own rule_taken base
+      if (options.rule_profile)
+        out << "      rule_taken = UINT64_C(" << slot.base << ");\n";
+
+      IndexFilter filter;
+      bool filtered = get_index_filter(*r, filter);
+
+      // conditions on which the rule branches, with any profile-guided hints
+      std::string g_enabled = "g == 1";
+      std::string inserted = "set_insert(n, &size, duplicate)";
+      if (slot.profile != nullptr) {
+        g_enabled = expect(g_enabled, slot.profile->enabled,
+          slot.profile->evaluated);
+        inserted = expect(inserted, slot.profile->fresh,
+          slot.profile->successors);
+      }
+      if (filtered) {
+        out << "#if GUARD_CACHE_BITS == 0\n";
+        generate_index_scan(out, filter);
+        out << "#endif\n";
+      }
+
+      for (const Quantifier &q : r->quantifiers)
+        generate_quantifier_header(out, q);
+
+      out
+        << "      if (!JMP_BUF_NEEDED || ++expansion.step > expansion.done) {\n"
+        << "#if RULE_STATISTICS > 0\n"
+        << "      const uint64_t rule_start = rule_statistics_now();\n"
+        << "      rule_statistics_local[rule_taken - 1].evaluated++;\n"
+        << "#endif\n"
+        // Use a dummy do-while to give us 'break' as a local goto.
+        << "      do {\n"
+        << "#if RULE_PROFILE_RULES > 0\n"
+        << "        rule_profile_local[" << index << "].evaluated++;\n"
+        << "#endif\n"
+        << "#if GUARD_CACHE_BITS > 0\n"
+        << "        if (bitmap_get(guards_failed, rule_taken - 1) ||\n"
+        << "            !bitmap_get(guards_enabled, rule_taken - 1)) {\n"
+        << "          /* guard errored or is known to be false */\n"
+        << "          break;\n"
+        << "        }\n"
+        << "#endif\n";
+      if (filtered) {
+        out
+          << "#if GUARD_CACHE_BITS == 0\n"
+          << "        if (!" << index_filter_test(filter) << ") {\n"
+          << "          /* guard is false for this index */\n"
+          << "          break;\n"
+          << "        }\n"
+          << "#endif\n";
+      }
+      out
+        << "        struct state *n = state_dup(s);\n"
+        << "        expansion.successor = n;\n"
+        << "#if COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+        << "        state_rule_taken_set(n, rule_taken);\n"
+        << "#endif\n"
+        << "#if GUARD_CACHE_BITS > 0\n"
+        << "        int g = 1;\n"
+        << "#else\n"
+        << "#if RULE_STATISTICS > 0\n"
+        << "        rule_statistics_local[rule_taken - 1].guards++;\n"
+        << "#endif\n"
+        << "        int g = guard" << index << "(n";
+      for (const Quantifier &q : r->quantifiers)
+        out << ", ru_" << q.name;
+      out << ");\n"
+        << "#endif\n"
+        << "        if (" << g_enabled << ") {\n"
+        << "#if RULE_PROFILE_RULES > 0\n"
+        << "          rule_profile_local[" << index << "].enabled++;\n"
+        << "#endif\n"
+        << "          (void)rule" << index << "(n";
+      for (const Quantifier &q : r->quantifiers)
+        out << ", ru_" << q.name;
+      out << ");\n"
+        << "          rules_fired_local++;\n"
+        << "#if RULE_STATISTICS > 0\n"
+        << "          rule_statistics_local[rule_taken - 1].fired++;\n"
+        << "#endif\n"
+        << "#if LIVE_COUNTERS\n"
+        << "          telemetry_add(&telemetry[thread_id].rules_fired, 1);\n"
+        << "#endif\n"
+        << "          if (DEADLOCK_DETECTION != DEADLOCK_DETECTION_STUTTERING || !state_eq(s, n)) {\n"
+        << "            expansion.possible_deadlock = false;\n"
+        << "          }\n"
+        << "          state_canonicalise(n);\n"
+        << "#if GUARD_CACHE_BITS > 0\n"
+        << "          guard_cache_inherit(n, guards_known, guards_enabled,\n"
+        << "            GUARD_UNAFFECTED[" << index << "], GUARD_START, GUARD_RULES);\n"
+        << "#endif\n"
+        << "          if (!check_assumptions(n)) {\n"
+        << "            /* assumption violated */\n"
+        << "            state_free(n);\n"
+        << "            break;\n"
+        << "          }\n"
+        << "          (void)check_invariants(n);\n"
+        << "          size_t size;\n"
+        << "#if EDGE_LOG\n"
+        << "          const struct state *existing = NULL;\n"
+        << "          const struct state **duplicate = &existing;\n"
+        << "#else\n"
+        << "          const struct state **duplicate = NULL;\n"
+        << "#endif\n"
+        << "#if RULE_PROFILE_RULES > 0\n"
+        << "          rule_profile_local[" << index << "].successors++;\n"
+        << "#endif\n"
+        << "          if (" << inserted << ") {\n"
+        << "            /* the seen set now owns this state */\n"
+        << "            expansion.successor = NULL;\n"
+        << "#if RULE_PROFILE_RULES > 0\n"
+        << "            rule_profile_local[" << index << "].fresh++;\n"
+        << "#endif\n"
+        << "#if RULE_STATISTICS > 0\n"
+        << "            rule_statistics_local[rule_taken - 1].fresh++;\n"
+        << "#endif\n"
+        << "#if LIVE_COUNTERS\n"
+        << "            telemetry_add(&telemetry[thread_id].states, 1);\n"
+        << "#endif\n"
+        << "#if EDGE_LOG\n"
+        << "            edge_log_append(s, n, rule_taken);\n"
+        << "#endif\n"
+        << "\n"
+        << "            (void)check_covers(n);\n"
+        << "#if LIVENESS_COUNT > 0\n"
+        << "            (void)check_liveness(n);\n"
+        << "#endif\n"
+        << "\n"
+        << "#if BOUND > 0\n"
+        << "            if (state_bound_get(n) < BOUND) {\n"
+        << "#endif\n"
+        << "            work_enqueued();\n"
+        << "            size_t queue_size = queue_enqueue(n, thread_id);\n"
+        << "            idle_wake(1);\n"
+        << "            queue_id = thread_id;\n"
+        << "\n"
+        << "            if (size % 10000 == 0) {\n"
+        << "              output_begin();\n"
+        << "              if (MACHINE_READABLE_OUTPUT) {\n"
+        << "                put(\"<progress states=\\\"\");\n"
+        << "                put_uint(size);\n"
+        << "                put(\"\\\" duration_seconds=\\\"\");\n"
+        << "                put_uint(gettime());\n"
+        << "                put(\"\\\" rules_fired=\\\"\");\n"
+        << "                put_uint(rules_fired_local);\n"
+        << "                put(\"\\\" queue_size=\\\"\");\n"
+        << "                put_uint(queue_size);\n"
+        << "                put(\"\\\" thread_id=\\\"\");\n"
+        << "                put_uint(thread_id);\n"
+        << "                put(\"\\\"/>\\n\");\n"
+        << "              } else {\n"
+        << "                put(\"\\t \");\n"
+        << "                if (THREADS > 1) {\n"
+        << "                  put(\"thread \");\n"
+        << "                  put_uint(thread_id);\n"
+        << "                  put(\": \");\n"
+        << "                }\n"
+        << "                put_uint(size);\n"
+        << "                put(\" states explored in \");\n"
+        << "                put_uint(gettime());\n"
+        << "                put(\"s, with \");\n"
+        << "                put_uint(rules_fired_local);\n"
+        << "                put(\" rules fired and \");\n"
+        << "                put(queue_size > last_queue_size ? yellow() : green());\n"
+        << "                put_uint(queue_size);\n"
+        << "                put(reset());\n"
+        << "                put(\" states in the queue.\\n\");\n"
+        << "              }\n"
+        << "              output_end();\n"
+        << "              last_queue_size = queue_size;\n"
+        << "            }\n"
+        << "\n"
+        << "            if (THREADS > 1 && thread_id == 0 && phase == WARMUP && queue_size > 20) {\n"
+        << "              start_secondary_threads();\n"
+        << "              phase = RUN;\n"
+        << "            }\n"
+        << "\n"
+        << "#if BOUND > 0\n"
+        << "            }\n"
+        << "#endif\n"
+        << "          } else {\n"
+        << "#if RULE_STATISTICS > 0\n"
+        << "            rule_statistics_local[rule_taken - 1].duplicates++;\n"
+        << "#endif\n"
+        << "#if EDGE_LOG\n"
+        << "            edge_log_append(s, existing, rule_taken);\n"
+        << "#endif\n"
+        << "            state_free(n);\n"
+        << "          }\n"
+        << "        } else {\n"
+        << "          state_free(n);\n"
+        << "        }\n"
+        << "      } while (0);\n"
+        << "#if RULE_STATISTICS > 0\n"
+        << "      rule_statistics_local[rule_taken - 1].time +=\n"
+        << "        rule_statistics_now() - rule_start;\n"
+        << "#endif\n"
+        << "      }\n"
+        << "      rule_taken++;\n";
+
+      // Close the quantifier loops.
+      for (auto it = r->quantifiers.rbegin(); it != r->quantifiers.rend(); it++)
+        generate_quantifier_footer(out, *it);
+
+      // Close this rule's scope.
+      out << "}\n";
+    }
     out
       << "    /* If we did not toggle 'possible_deadlock' off by this point, we\n"
       << "     * have a deadlock.\n"
       << "     */\n"
-      << "    if (DEADLOCK_DETECTION != DEADLOCK_DETECTION_OFF && possible_deadlock) {\n"
+      << "    if (DEADLOCK_DETECTION != DEADLOCK_DETECTION_OFF\n"
+      << "        && (!JMP_BUF_NEEDED || ++expansion.step > expansion.done)\n"
+      << "        && expansion.possible_deadlock) {\n"
+      << "      expansion.successor = NULL;\n"
       << "      deadlock(s);\n"
       << "    }\n"
+      << "#if TRACE_REPLAY && COUNTEREXAMPLE_TRACE != CEX_OFF\n"
+      << "    replay_expanding = NULL;\n"
+      << "#endif\n"
+      << "    work_finished();\n"
+      << "    expansion.state = NULL;\n"
       << "\n"
       << "  }\n"
       << "  exit_with(EXIT_SUCCESS);\n"
       << "}\n\n";
   }
 
+  generate_rule_statistics(out, flat_rules);
+
   // Write a function to print the state.
   out << "static void state_print(const struct state *previous, const struct "
     << "state *NONNULL s) {\n";
@@ -1025,7 +1582,8 @@ void generate_model(std::ostream &out, const Model &m) {
 
   // Write a function to print state transitions.
   out
-    << "static void print_transition(const struct state *NONNULL s "
+    << "static void print_transition(const struct state *previous "
+      << "__attribute__((unused)), const struct state *NONNULL s "
       << "__attribute__((unused))) {\n"
     << "  ASSERT(s != NULL);\n"
     << "  static const char *rule_name __attribute__((unused)) = NULL;\n"
@@ -1036,7 +1594,7 @@ void generate_model(std::ostream &out, const Model &m) {
 
   {
     out
-      << "  if (state_previous_get(s) == NULL) {\n"
+      << "  if (previous == NULL) {\n"
       << "    uint64_t rule_taken = 1;\n";
 
     mpz_class base = 1;
@@ -1273,7 +1831,7 @@ void generate_model(std::ostream &out, const Model &m) {
                   << "        if (USE_SCALARSET_SCHEDULES) {\n"
                   // note that we read from the *previous* state’s schedule here
                   // because that is what this value is relative to
-                  << "          size_t index = schedule_read_" << id->name << "(state_previous_get(s));\n"
+                  << "          size_t index = schedule_read_" << id->name << "(previous);\n"
                   << "          size_t stack[" << b << "];\n"
                   << "          index_to_permutation(index, schedule, stack, " << b << ");\n"
                   << "        }\n";
@@ -1346,7 +1904,8 @@ void generate_model(std::ostream &out, const Model &m) {
     << "  }\n"
     << "\n"
     << "  /* give some helpful output for debugging problems with this function. */\n"
-    << "  fprintf(stderr, \"no rule found to link to state at depth %zu\\n\", state_depth(s));\n"
+    << "  fprintf(stderr, \"no rule found for transition %llu\\n\",\n"
+    << "    (unsigned long long)state_rule_taken_get(s));\n"
     << "  ASSERT(!\"unreachable\");\n"
     << "#endif\n"
     << "}\n\n";
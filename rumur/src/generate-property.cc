@@ -6,5 +6,5 @@
 using namespace rumur;
 
 void generate_property(std::ostream &out, const Property &p) {
-  generate_rvalue(out, *p.expr);
+  generate_pure_rvalue(out, *p.expr);
 }
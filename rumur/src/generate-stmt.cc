@@ -104,7 +104,19 @@ class Generator : public ConstStmtTraversal {
     
   void visit_assignment(const Assignment &s) final {
 
-    if (s.lhs->type()->is_simple()) {
+    mpz_class offset;
+    if (s.lhs->type()->is_simple() && get_state_offset(*s.lhs, offset)) {
+      const std::string lb = s.lhs->type()->lower_bound();
+      const std::string ub = s.lhs->type()->upper_bound();
+
+      // the location being written is known now, so bypass handles
+      *out << "state_write(" << to_C_string(s.loc) << ", rule_name, "
+        << to_C_string(*s.lhs) << ", s, " << lb << ", " << ub << ", "
+        << offset << "ull, " << s.lhs->type()->width() << "ull, ";
+      generate_rvalue(*out, *s.rhs);
+      *out << ")";
+
+    } else if (s.lhs->type()->is_simple()) {
       const std::string lb = s.lhs->type()->lower_bound();
       const std::string ub = s.lhs->type()->upper_bound();
 
@@ -116,7 +128,7 @@ class Generator : public ConstStmtTraversal {
       *out << ")";
 
     } else {
-      *out << "handle_copy(";
+      *out << "handle_copy(s, ";
       generate_lvalue(*out, *s.lhs);
       *out << ", ";
       generate_rvalue(*out, *s.rhs);
@@ -316,7 +328,7 @@ class Generator : public ConstStmtTraversal {
          */
         *out
           << "do {\n"
-          << "  handle_copy(ret, ";
+          << "  handle_copy(s, ret, ";
         generate_rvalue(*out, *s.expr);
         *out << ");\n"
           << "  return ret;\n"
@@ -367,7 +379,7 @@ class Generator : public ConstStmtTraversal {
   }
 
   void visit_undefine(const Undefine &s) final {
-    *out << "handle_zero(";
+    *out << "handle_zero(s, ";
     generate_lvalue(*out, *s.rhs);
     *out << ")";
   }
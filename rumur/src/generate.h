@@ -34,9 +34,27 @@ void generate_print(std::ostream &out, const rumur::TypeExpr &e,
 
 void generate_property(std::ostream &out, const rumur::Property &p);
 
+// If the given expression denotes a state component whose location is known
+// at generation time, set `offset` to its bit offset within the state data and
+// return true.
+bool get_state_offset(const rumur::Expr &e, mpz_class &offset);
+
+// If the given expression denotes a state component whose location is known
+// at generation time but for an array index given by the quantifier `q`, set
+// `base` and `stride` such that its bit offset when `q` takes its n-th value
+// (counting from 0) is `base + n * stride` and return true.
+bool get_quantified_state_offset(const rumur::Expr &e,
+  const rumur::Quantifier &q, mpz_class &base, mpz_class &stride);
+
 void generate_lvalue(std::ostream &out, const rumur::Expr &e);
 void generate_rvalue(std::ostream &out, const rumur::Expr &e);
 
+/* Generate an rvalue, reading each simple value that appears more than once in
+ * the expression only once. Only expressions without side effects benefit, as
+ * in others the state may change between reads.
+ */
+void generate_pure_rvalue(std::ostream &out, const rumur::Expr &e);
+
 void generate_quantifier_header(std::ostream &out, const rumur::Quantifier &q);
 void generate_quantifier_footer(std::ostream &out, const rumur::Quantifier &q);
 
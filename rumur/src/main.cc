@@ -1,10 +1,13 @@
 #include <algorithm>
+#include "align-fields.h"
 #include <cassert>
+#include <climits>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include "environ.h"
+#include "fold-constants.h"
 #include <fstream>
 #include "generate.h"
 #include <getopt.h>
@@ -16,12 +19,14 @@
 #include "optimise-field-ordering.h"
 #include "options.h"
 #include "resources.h"
+#include "rule-profile.h"
 #include <rumur/rumur.h>
 #include "smt/except.h"
 #include "smt/simplify.h"
 #include <spawn.h>
 #include <sstream>
 #include <string>
+#include "symmetry-reduction.h"
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -50,16 +55,27 @@ static void parse_args(int argc, char **argv) {
 
   for (;;) {
     enum {
-      OPT_BOUND = 128,
+      OPT_ALIGN_FIELDS = 128,
+      OPT_BOUND,
       OPT_COLOUR,
       OPT_COUNTEREXAMPLE_TRACE,
       OPT_DEADLOCK_DETECTION,
+      OPT_DEDUPLICATE_ERRORS,
+      OPT_EDGE_LOG,
+      OPT_EXPECTED_STATES,
+      OPT_FOLD_CONSTANTS,
+      OPT_GUARD_CACHE,
+      OPT_INCREMENTAL_HASH,
       OPT_MAX_ERRORS,
+      OPT_METRICS_SOCKET,
       OPT_MONOPOLISE,
       OPT_OUTPUT_FORMAT,
       OPT_PACK_STATE,
       OPT_POINTER_BITS,
       OPT_REORDER_FIELDS,
+      OPT_RULE_PROFILE,
+      OPT_RULE_PROFILE_GENERATE,
+      OPT_RULE_STATISTICS,
       OPT_SANDBOX,
       OPT_SCALARSET_SCHEDULES,
       OPT_SMT_ARG,
@@ -70,20 +86,32 @@ static void parse_args(int argc, char **argv) {
       OPT_SMT_PRELUDE,
       OPT_SMT_SIMPLIFICATION,
       OPT_SYMMETRY_REDUCTION,
+      OPT_TELEMETRY,
+      OPT_TELEMETRY_INTERVAL,
+      OPT_THREAD_STARTUP,
       OPT_TRACE,
+      OPT_TRACE_REPLAY,
       OPT_VALUE_TYPE,
       OPT_VERSION,
     };
 
     static struct option opts[] = {
+      { "align-fields", required_argument, 0, OPT_ALIGN_FIELDS },
       { "bound", required_argument, 0, OPT_BOUND },
       { "color", required_argument, 0, OPT_COLOUR },
       { "colour", required_argument, 0, OPT_COLOUR },
       { "counterexample-trace", required_argument, 0, OPT_COUNTEREXAMPLE_TRACE },
       { "deadlock-detection", required_argument, 0, OPT_DEADLOCK_DETECTION },
       { "debug", no_argument, 0, 'd' },
+      { "deduplicate-errors", required_argument, 0, OPT_DEDUPLICATE_ERRORS },
+      { "edge-log", required_argument, 0, OPT_EDGE_LOG },
+      { "expected-states", required_argument, 0, OPT_EXPECTED_STATES },
+      { "fold-constants", required_argument, 0, OPT_FOLD_CONSTANTS },
+      { "guard-cache", required_argument, 0, OPT_GUARD_CACHE },
       { "help", no_argument, 0, 'h' },
+      { "incremental-hash", required_argument, 0, OPT_INCREMENTAL_HASH },
       { "max-errors", required_argument, 0, OPT_MAX_ERRORS },
+      { "metrics-socket", required_argument, 0, OPT_METRICS_SOCKET },
       { "monopolise", no_argument, 0, OPT_MONOPOLISE },
       { "monopolize", no_argument, 0, OPT_MONOPOLISE },
       { "output", required_argument, 0, 'o' },
@@ -92,6 +120,9 @@ static void parse_args(int argc, char **argv) {
       { "pointer-bits", required_argument, 0, OPT_POINTER_BITS },
       { "quiet", no_argument, 0, 'q' },
       { "reorder-fields", required_argument, 0, OPT_REORDER_FIELDS },
+      { "rule-profile", required_argument, 0, OPT_RULE_PROFILE },
+      { "rule-profile-generate", required_argument, 0, OPT_RULE_PROFILE_GENERATE },
+      { "rule-statistics", required_argument, 0, OPT_RULE_STATISTICS },
       { "sandbox", required_argument, 0, OPT_SANDBOX },
       { "scalarset-schedules", required_argument, 0, OPT_SCALARSET_SCHEDULES },
       { "set-capacity", required_argument, 0, 's' },
@@ -104,8 +135,12 @@ static void parse_args(int argc, char **argv) {
       { "smt-prelude", required_argument, 0, OPT_SMT_PRELUDE },
       { "smt-simplification", required_argument, 0, OPT_SMT_SIMPLIFICATION },
       { "symmetry-reduction", required_argument, 0, OPT_SYMMETRY_REDUCTION },
+      { "telemetry", required_argument, 0, OPT_TELEMETRY },
+      { "telemetry-interval", required_argument, 0, OPT_TELEMETRY_INTERVAL },
+      { "thread-startup", required_argument, 0, OPT_THREAD_STARTUP },
       { "threads", required_argument, 0, 't' },
       { "trace", required_argument, 0, OPT_TRACE },
+      { "trace-replay", required_argument, 0, OPT_TRACE_REPLAY },
       { "value-type", required_argument, 0, OPT_VALUE_TYPE },
       { "verbose", no_argument, 0, 'v' },
       { "version", no_argument, 0, OPT_VERSION },
@@ -238,6 +273,18 @@ static void parse_args(int argc, char **argv) {
         }
         break;
 
+      case OPT_TRACE_REPLAY: // --trace-replay ...
+        if (strcmp(optarg, "on") == 0) {
+          options.trace_replay = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.trace_replay = false;
+        } else {
+          std::cerr << "invalid argument to --trace-replay, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_DEADLOCK_DETECTION: // --deadlock-detection ...
         if (strcmp(optarg, "off") == 0) {
           options.deadlock_detection = DeadlockDetection::OFF;
@@ -278,6 +325,84 @@ static void parse_args(int argc, char **argv) {
         break;
       }
 
+      case OPT_DEDUPLICATE_ERRORS: // --deduplicate-errors ...
+        if (strcmp(optarg, "on") == 0) {
+          options.deduplicate_errors = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.deduplicate_errors = false;
+        } else {
+          std::cerr << "invalid argument to --deduplicate-errors, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_EDGE_LOG: // --edge-log ...
+        if (strcmp(optarg, "on") == 0) {
+          options.edge_log = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.edge_log = false;
+        } else {
+          std::cerr << "invalid argument to --edge-log, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_EXPECTED_STATES: { // --expected-states ...
+        bool valid = true;
+        try {
+          options.expected_states = optarg;
+          // the verifier scales this by 100 / --set-expand-threshold
+          if (options.expected_states <= 0 ||
+              options.expected_states > mpz_class(ULONG_MAX / 100))
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --expected-states argument \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
+      case OPT_FOLD_CONSTANTS: // --fold-constants ...
+        if (strcmp(optarg, "on") == 0) {
+          options.fold_constants = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.fold_constants = false;
+        } else {
+          std::cerr << "invalid argument to --fold-constants, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_GUARD_CACHE: // --guard-cache ...
+        if (strcmp(optarg, "on") == 0) {
+          options.guard_cache = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.guard_cache = false;
+        } else {
+          std::cerr << "invalid argument to --guard-cache, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case OPT_INCREMENTAL_HASH: // --incremental-hash ...
+        if (strcmp(optarg, "on") == 0) {
+          options.incremental_hash = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.incremental_hash = false;
+        } else {
+          std::cerr << "invalid argument to --incremental-hash, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_PACK_STATE: // --pack-state ...
         if (strcmp(optarg, "on") == 0) {
           options.pack_state = true;
@@ -323,6 +448,52 @@ static void parse_args(int argc, char **argv) {
         }
         break;
 
+      case OPT_TELEMETRY: { // --telemetry ...
+        bool valid = true;
+        try {
+          options.telemetry_fd = optarg;
+          if (options.telemetry_fd < 0 || !options.telemetry_fd.fits_sint_p())
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --telemetry argument \"" << optarg << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
+      case OPT_TELEMETRY_INTERVAL: { // --telemetry-interval ...
+        bool valid = true;
+        try {
+          options.telemetry_interval = optarg;
+          if (options.telemetry_interval <= 0 ||
+              !options.telemetry_interval.fits_ulong_p())
+            valid = false;
+        } catch (std::invalid_argument&) {
+          valid = false;
+        }
+        if (!valid) {
+          std::cerr << "invalid --telemetry-interval argument \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+
+      case OPT_THREAD_STARTUP: // --thread-startup ...
+        if (strcmp(optarg, "eager") == 0) {
+          options.eager_startup = true;
+        } else if (strcmp(optarg, "warmup") == 0) {
+          options.eager_startup = false;
+        } else {
+          std::cerr << "invalid argument to --thread-startup, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_SANDBOX: // --sandbox ...
         if (strcmp(optarg, "on") == 0) {
           options.sandbox_enabled = true;
@@ -362,6 +533,10 @@ static void parse_args(int argc, char **argv) {
         break;
       }
 
+      case OPT_METRICS_SOCKET: // --metrics-socket ...
+        options.metrics_socket = optarg;
+        break;
+
       case OPT_COUNTEREXAMPLE_TRACE: // --counterexample-trace ...
         if (strcmp(optarg, "full") == 0) {
           options.counterexample_trace = CounterexampleTrace::FULL;
@@ -394,6 +569,18 @@ static void parse_args(int argc, char **argv) {
         std::cout << "Rumur version " << get_version() << "\n";
         exit(EXIT_SUCCESS);
 
+      case OPT_ALIGN_FIELDS: // --align-fields ...
+        if (strcmp(optarg, "on") == 0) {
+          options.align_fields = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.align_fields = false;
+        } else {
+          std::cerr << "invalid argument to --align-fields, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_BOUND: { // --bound ...
         bool valid = true;
         try {
@@ -426,6 +613,32 @@ static void parse_args(int argc, char **argv) {
         }
         break;
 
+      case OPT_RULE_PROFILE: { // --rule-profile ...
+        const std::string err = load_rule_profile(optarg);
+        if (err != "") {
+          std::cerr << "failed to load rule profile: " << err << "\n";
+          exit(EXIT_FAILURE);
+        }
+        options.rule_profile = true;
+        break;
+      }
+
+      case OPT_RULE_PROFILE_GENERATE: // --rule-profile-generate ...
+        options.rule_profile_generate = optarg;
+        break;
+
+      case OPT_RULE_STATISTICS: // --rule-statistics ...
+        if (strcmp(optarg, "on") == 0) {
+          options.rule_statistics = true;
+        } else if (strcmp(optarg, "off") == 0) {
+          options.rule_statistics = false;
+        } else {
+          std::cerr << "invalid argument to --rule-statistics, \"" << optarg
+            << "\"\n";
+          exit(EXIT_FAILURE);
+        }
+        break;
+
       case OPT_SMT_ARG: // --smt-arg ...
         options.smt.args.emplace_back(optarg);
         if (options.smt.simplification == SmtSimplification::AUTO) {
@@ -691,12 +904,55 @@ int main(int argc, char **argv) {
     }
   }
 
+  // simplify constant parts of the model
+  if (options.fold_constants) {
+    *debug << "folding constants...\n";
+    fold_constants(*m);
+  }
+
+  // check whether the rule profile covers the model's rules
+  if (options.rule_profile) {
+    size_t index = 0;
+    size_t missing = 0;
+    for (const Ptr<Rule> &r : m->rules) {
+      for (const Ptr<Rule> &f : r->flatten()) {
+        if (isa<SimpleRule>(f)) {
+          if (get_rule_profile(rule_profile_key(*f, index)) == nullptr)
+            missing++;
+          index++;
+        }
+      }
+    }
+    if (missing > 0)
+      *warn << "warning: " << missing << " rule(s) have no entry in the rule "
+        << "profile and will be tried last\n";
+  }
+
+  /* The guard cache assumes a successor's guards see the same values as its
+   * predecessor's did for state variables the rule leading to it did not
+   * touch. Symmetry reduction can permute any part of a state, invalidating
+   * this.
+   */
+  if (options.guard_cache &&
+      options.symmetry_reduction != SymmetryReduction::OFF &&
+      !get_scalarsets(*m).empty()) {
+    *warn << "the guard cache cannot be used with symmetry reduction, so it "
+      << "will be disabled\n";
+    options.guard_cache = false;
+  }
+
   // re-order fields to optimise access to them
   if (options.reorder_fields) {
     *debug << "optimising field ordering...\n";
     optimise_field_ordering(*m);
   }
 
+  // pad state variables out to byte boundaries if requested
+  if (options.align_fields) {
+    *debug << "aligning fields...\n";
+    align_fields(*m);
+  }
+
   // get value_t to use in the checker
   *debug << "determining value_t type...\n";
   std::pair<ValueType, ValueType> value_types;
@@ -1,9 +1,15 @@
+#include <algorithm>
 #include <cstddef>
 #include <gmpxx.h>
 #include "log.h"
+#include <map>
 #include "optimise-field-ordering.h"
 #include <rumur/rumur.h>
+#include <set>
+#include "state-accesses.h"
 #include <string>
+#include <utility>
+#include "utils.h"
 #include <vector>
 
 using namespace rumur;
@@ -87,6 +93,109 @@ static void notify_changes(const std::vector<std::string> &original,
   }
 }
 
+// state variable accesses of a model's rules
+namespace { struct AccessProfile {
+
+  // variables read by any guard
+  std::set<std::string> guard_reads;
+
+  // number of rules in which each pair of variables are both accessed
+  std::map<std::pair<std::string, std::string>, size_t> affinity;
+
+  size_t get_affinity(const std::string &a, const std::string &b) const {
+    auto it = affinity.find(a < b ? std::make_pair(a, b) : std::make_pair(b, a));
+    return it == affinity.end() ? 0 : it->second;
+  }
+}; }
+
+static AccessProfile profile_accesses(const Model &m) {
+
+  AccessProfile p;
+
+  for (const Ptr<Rule> &rule : m.rules) {
+    for (const Ptr<Rule> &r : rule->flatten()) {
+
+      const std::set<std::string> accessed = state_accesses(*r);
+
+      if (auto s = dynamic_cast<const SimpleRule*>(r.get())) {
+        if (s->guard != nullptr) {
+          const std::set<std::string> guard = state_accesses(*s->guard);
+          p.guard_reads.insert(guard.begin(), guard.end());
+        }
+      }
+
+      for (const std::string &a : accessed) {
+        for (const std::string &b : accessed) {
+          if (a < b)
+            p.affinity[std::make_pair(a, b)]++;
+        }
+      }
+    }
+  }
+
+  return p;
+}
+
+/* Refine an ordering of state variables based on how rules access them. Fields
+ * read by guards are moved to the front of the state, as these are accessed for
+ * every state that is expanded. Within this and the remaining fields, we then
+ * greedily chain together fields that are frequently accessed by the same
+ * rules, so they are more likely to share a cache line. The incoming ordering
+ * is used to break ties.
+ */
+static void order_by_affinity(std::vector<Ptr<VarDecl>> &vars,
+    const AccessProfile &p) {
+
+  std::vector<Ptr<VarDecl>> guarded;
+  std::vector<Ptr<VarDecl>> unguarded;
+  for (Ptr<VarDecl> &v : vars) {
+    if (p.guard_reads.count(v->name) > 0) {
+      guarded.push_back(std::move(v));
+    } else {
+      unguarded.push_back(std::move(v));
+    }
+  }
+
+  if (!guarded.empty()) {
+    *debug << "fields read by guards {";
+    std::string sep;
+    for (const Ptr<VarDecl> &v : guarded) {
+      *debug << sep << v->name;
+      sep = ", ";
+    }
+    *debug << "}\n";
+  }
+
+  std::vector<Ptr<VarDecl>> result;
+  for (std::vector<Ptr<VarDecl>> *group : { &guarded, &unguarded }) {
+
+    std::vector<Ptr<VarDecl>> &remaining = *group;
+    bool first = true;
+
+    while (!remaining.empty()) {
+
+      // find the remaining field with the most affinity to the last placed
+      auto next = remaining.begin();
+      if (!first) {
+        size_t best = 0;
+        for (auto it = remaining.begin(); it != remaining.end(); ++it) {
+          size_t a = p.get_affinity(result.back()->name, (*it)->name);
+          if (a > best) {
+            best = a;
+            next = it;
+          }
+        }
+      }
+
+      result.push_back(std::move(*next));
+      remaining.erase(next);
+      first = false;
+    }
+  }
+
+  vars = std::move(result);
+}
+
 // a traversal that reorders fields
 namespace { class Reorderer : public Traversal {
 
@@ -126,6 +235,9 @@ namespace { class Reorderer : public Traversal {
     // sort the variables
     sort(vars);
 
+    // refine the ordering based on which variables rules access together
+    order_by_affinity(vars, profile_accesses(n));
+
     notify_changes(original, vars);
 
     // the offset of each variable within the model state is now inaccurate, so
@@ -164,4 +276,7 @@ namespace { class Reorderer : public Traversal {
 void optimise_field_ordering(Model &m) {
   Reorderer r;
   r.dispatch(m);
+
+  // variables may have moved, so update references to them
+  update_state_offsets(m);
 }
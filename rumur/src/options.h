@@ -54,9 +54,17 @@ enum struct SmtSimplification {
 
 struct Options {
   mpz_class threads = 0;
+
+  // whether to start all threads before generating the start states, instead
+  // of once the first thread has built up some queued states
+  bool eager_startup = false;
   LogLevel log_level = LogLevel::WARNINGS;
   mpz_class set_capacity = 8 * 1024 * 1024;
 
+  // number of states the seen set should hold without expanding (0 == size it
+  // from set_capacity instead)
+  mpz_class expected_states = 0;
+
   /* Limit (percentage occupancy) at which we expand the capacity of the state
    * set.
    */
@@ -80,9 +88,16 @@ struct Options {
   // Number of errors to report before exiting.
   mpz_class max_errors = 1;
 
+  // whether repeats of an already reported error are only counted
+  bool deduplicate_errors = false;
+
   // How to print counterexample traces
   CounterexampleTrace counterexample_trace = CounterexampleTrace::DIFF;
 
+  // whether counterexample traces are reconstructed by searching from the start
+  // states instead of following per-state predecessor pointers
+  bool trace_replay = false;
+
   // Print output as XML?
   bool machine_readable_output = false;
 
@@ -95,9 +110,42 @@ struct Options {
   // whether to bit-pack members of the state struct
   bool pack_state = true;
 
+  // whether to maintain each state's hash incrementally as it is written
+  bool incremental_hash = false;
+
   // whether to optimise state variable and record fields ordering
   bool reorder_fields = true;
 
+  // whether to byte-align state variables instead of bit-packing them
+  bool align_fields = false;
+
+  // whether to simplify constant expressions, loops and branches in the model
+  bool fold_constants = true;
+
+  // whether states cache the results of evaluating rule guards against them
+  bool guard_cache = false;
+
+  // whether the checker records the transitions it explores
+  bool edge_log = false;
+
+  // whether rule evaluation is ordered by a profile loaded via --rule-profile
+  bool rule_profile = false;
+
+  // path the checker should write a rule profile to ("" for none)
+  std::string rule_profile_generate;
+
+  // whether the checker counts and times the evaluation of each rule
+  bool rule_statistics = false;
+
+  // file descriptor the checker writes telemetry records to (-1 == none)
+  mpz_class telemetry_fd = -1;
+
+  // milliseconds between telemetry records
+  mpz_class telemetry_interval = 1000;
+
+  // path of a Unix domain socket the checker serves metrics on ("" for none)
+  std::string metrics_socket;
+
   // whether to track schedules during scalarset permutation
   bool scalarset_schedules = true;
 
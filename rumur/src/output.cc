@@ -1,6 +1,8 @@
 #include "assume-statements-count.h"
 #include <cassert>
 #include <cstddef>
+#include <cstdio>
+#include <ctype.h>
 #include <fstream>
 #include <iostream>
 #include "generate.h"
@@ -8,12 +10,14 @@
 #include "options.h"
 #include "prints-scalarsets.h"
 #include "resources.h"
+#include "rule-profile.h"
 #include <rumur/rumur.h>
 #include <string>
 #include "symmetry-reduction.h"
 #include <utility>
 #include "utils.h"
 #include "ValueType.h"
+#include <vector>
 
 using namespace rumur;
 
@@ -170,6 +174,75 @@ static mpz_class schedule_bits(const Model &model) {
   return bits;
 }
 
+// number of bits required to store the state data, including any padding
+// between variables introduced by --align-fields
+static mpz_class state_size_bits(const Model &model) {
+
+  mpz_class bits = 0;
+
+  for (const Ptr<Decl> &d : model.decls) {
+    if (auto v = dynamic_cast<const VarDecl*>(d.get())) {
+      const mpz_class end = v->offset + v->type->width();
+      if (end > bits)
+        bits = end;
+    }
+  }
+
+  return bits;
+}
+
+/* Quote a string as a C string literal whose value is the string itself. Note
+ * that escape() is not suitable for this, as it produces text intended to be
+ * shown to the user by the checker.
+ */
+static std::string c_string_literal(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (iscntrl(static_cast<unsigned char>(c))) {
+      char buffer[sizeof("\\000")];
+      snprintf(buffer, sizeof(buffer), "\\%03o",
+        static_cast<unsigned char>(c));
+      out += buffer;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// emit the rules the checker should count for --rule-profile-generate
+static void output_rule_profile(std::ostream &out, const Model &model) {
+
+  std::vector<std::string> keys;
+  if (options.rule_profile_generate != "") {
+    size_t index = 0;
+    for (const Ptr<Rule> &r : model.rules) {
+      for (const Ptr<Rule> &f : r->flatten()) {
+        if (isa<SimpleRule>(f)) {
+          keys.push_back(rule_profile_key(*f, index));
+          index++;
+        }
+      }
+    }
+  }
+
+  out << "#define RULE_PROFILE_RULES " << keys.size() << "\n";
+
+  if (!keys.empty()) {
+    out << "static const char RULE_PROFILE_PATH[] = "
+      << c_string_literal(options.rule_profile_generate) << ";\n"
+      << "static const char *RULE_PROFILE_NAMES[] = {\n";
+    for (const std::string &key : keys)
+      out << "  " << c_string_literal(key) << ",\n";
+    out << "};\n";
+  }
+
+  out << "\n";
+}
+
 int output_checker(const std::string &path, const Model &model,
     const std::pair<ValueType, ValueType> &value_types) {
 
@@ -188,6 +261,7 @@ int output_checker(const std::string &path, const Model &model,
 
     // Settings that are used in header.c
     << "enum { SET_CAPACITY = " << options.set_capacity << "ul };\n\n"
+    << "enum { EXPECTED_STATES = " << options.expected_states << "ul };\n\n"
     << "enum { SET_EXPAND_THRESHOLD = " << options.set_expand_threshold << " };\n\n"
     << "static const enum { OFF, ON, AUTO } COLOR = " << options.color << ";\n\n"
     << "enum trace_category_t {\n"
@@ -212,8 +286,28 @@ int output_checker(const std::string &path, const Model &model,
     << "#define SYMMETRY_REDUCTION " << options.symmetry_reduction << "\n\n"
     << "enum { SANDBOX_ENABLED = " << options.sandbox_enabled << " };\n\n"
     << "enum { MAX_ERRORS = " << options.max_errors << "ul };\n\n"
+    << "/* whether repeats of an already reported error are only counted */\n"
+    << "#define DEDUPLICATE_ERRORS " << options.deduplicate_errors << "\n\n"
     << "enum { THREADS = " << options.threads << "ul };\n\n"
-    << "enum { STATE_SIZE_BITS = " << model.size_bits() << "ul };\n\n"
+    << "/* whether to start all threads before generating the start states */\n"
+    << "enum { EAGER_STARTUP = " << options.eager_startup << " };\n\n"
+    << "/* number of guard results each state caches */\n"
+    << "#define GUARD_CACHE_BITS "
+      << (options.guard_cache ? rule_taken_max_rule(model) : mpz_class(0)) << "\n\n"
+    << "/* whether to reconstruct traces by search instead of predecessor pointers */\n"
+    << "#define TRACE_REPLAY " << options.trace_replay << "\n\n"
+    << "/* whether to record explored transitions */\n"
+    << "#define EDGE_LOG " << options.edge_log << "\n\n"
+    << "/* number of rule instances to collect statistics for */\n"
+    << "#define RULE_STATISTICS "
+      << (options.rule_statistics ? rule_taken_max_rule(model) : mpz_class(0)) << "\n\n"
+    << "/* file descriptor to write telemetry to (-1 for none) */\n"
+    << "#define TELEMETRY_FD " << options.telemetry_fd << "\n"
+    << "#define TELEMETRY_INTERVAL " << options.telemetry_interval << "ul\n\n"
+    << "#define METRICS_SOCKET " << (options.metrics_socket != "" ? 1 : 0) << "\n"
+    << "enum { STATE_SIZE_BITS = " << state_size_bits(model) << "ul };\n\n"
+    << "/* size of the state data if variables were bit-packed */\n"
+    << "enum { PACKED_STATE_SIZE_BITS = " << model.size_bits() << "ul };\n\n"
     << "enum { ASSUME_STATEMENTS_COUNT = " << assume_statements_count(model) << "ul };\n\n"
     << "#define LIVENESS_COUNT " << model.liveness_count() << "\n\n"
     << "#define CEX_OFF 0\n"
@@ -235,6 +329,7 @@ int output_checker(const std::string &path, const Model &model,
     << "#define PRIRAWVAL " << value_types.second.pri << "\n\n"
     << "#define RULE_TAKEN_LIMIT " << rule_taken_limit(model) << "\n"
     << "#define PACK_STATE " << (options.pack_state ? 1 : 0) << "\n"
+    << "#define INCREMENTAL_HASH " << (options.incremental_hash ? 1 : 0) << "\n"
     << "#define SCHEDULE_BITS " << schedule_bits(model) << "ul\n"
     << "#define PRINTS_SCALARSETS " << (prints_scalarsets(model) ? "1" : "0") << "\n"
     << "\n"
@@ -246,6 +341,12 @@ int output_checker(const std::string &path, const Model &model,
 
   generate_cover_array(out, model);
 
+  output_rule_profile(out, model);
+
+  if (options.metrics_socket != "")
+    out << "static const char METRICS_SOCKET_PATH[] = "
+      << c_string_literal(options.metrics_socket) << ";\n\n";
+
     // Static boiler plate code
   out
     << std::string((const char*)resources_header_c, resources_header_c_len)
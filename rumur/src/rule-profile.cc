@@ -0,0 +1,63 @@
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <rumur/rumur.h>
+#include "rule-profile.h"
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+using namespace rumur;
+
+// profile entries loaded from disk, keyed by rule_profile_key()
+static std::unordered_map<std::string, RuleProfile> profile;
+
+std::string rule_profile_key(const Rule &r, size_t index) {
+  if (r.name == "")
+    return std::to_string(index + 1);
+  return "\"" + r.name + "\"";
+}
+
+std::string load_rule_profile(const std::string &path) {
+
+  std::ifstream in(path);
+  if (!in)
+    return "could not open " + path;
+
+  /* Each line gives the evaluated, enabled, successors and fresh counts of a
+   * rule, followed by the rule's key. Lines beginning with '#' are comments.
+   */
+  std::string line;
+  for (size_t lineno = 1; std::getline(in, line); lineno++) {
+
+    if (line == "" || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    RuleProfile p;
+    fields >> p.evaluated >> p.enabled >> p.successors >> p.fresh;
+    if (!fields || fields.get() != ' ')
+      return path + ":" + std::to_string(lineno) + ": malformed entry";
+
+    std::string key;
+    std::getline(fields, key);
+    if (key == "")
+      return path + ":" + std::to_string(lineno) + ": missing rule name";
+
+    // rules may share a name, in which case we combine their statistics
+    RuleProfile &entry = profile[key];
+    entry.evaluated += p.evaluated;
+    entry.enabled += p.enabled;
+    entry.successors += p.successors;
+    entry.fresh += p.fresh;
+  }
+
+  return "";
+}
+
+const RuleProfile *get_rule_profile(const std::string &key) {
+  auto it = profile.find(key);
+  if (it == profile.end())
+    return nullptr;
+  return &it->second;
+}
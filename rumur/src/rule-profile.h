@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <rumur/rumur.h>
+#include <string>
+
+// how a rule behaved during a run of a checker built with --rule-profile-generate
+struct RuleProfile {
+  uint64_t evaluated = 0;  // number of times its guard was evaluated
+  uint64_t enabled = 0;    // number of these for which the guard held
+  uint64_t successors = 0; // number of successor states it produced
+  uint64_t fresh = 0;      // number of these that had not been seen before
+};
+
+/* Identifier for a rule within a profile. This is its name in quotes or, for an
+ * unnamed rule, its position among the model's rules, as in the checker's
+ * output.
+ */
+std::string rule_profile_key(const rumur::Rule &r, size_t index);
+
+/* Read a profile written by a checker. Returns an error message on failure or
+ * "" on success.
+ */
+std::string load_rule_profile(const std::string &path);
+
+// look up the profile of a rule, returning nullptr if the profile has no entry
+const RuleProfile *get_rule_profile(const std::string &key);
@@ -0,0 +1,44 @@
+#include <cstddef>
+#include <rumur/rumur.h>
+#include <set>
+#include "state-accesses.h"
+#include <string>
+
+using namespace rumur;
+
+namespace { class AccessCollector : public ConstTraversal {
+
+ public:
+  std::set<std::string> accessed;
+
+ private:
+  // functions we have already descended into, to cope with recursion
+  std::set<std::string> seen_functions;
+
+ public:
+  void visit_exprid(const ExprID &n) final {
+    if (auto v = dynamic_cast<const VarDecl*>(n.value.get())) {
+      if (v->offset >= 0)
+        accessed.insert(v->name);
+    } else if (auto a = dynamic_cast<const AliasDecl*>(n.value.get())) {
+      // an alias accesses whatever it refers to
+      dispatch(*a->value);
+    }
+  }
+
+  void visit_functioncall(const FunctionCall &n) final {
+    for (const Ptr<Expr> &a : n.arguments)
+      dispatch(*a);
+    // also account for state variables read or written within the callee
+    if (n.function != nullptr && seen_functions.insert(n.name).second)
+      dispatch(*n.function);
+  }
+
+  virtual ~AccessCollector() = default;
+}; }
+
+std::set<std::string> state_accesses(const Node &n) {
+  AccessCollector c;
+  c.dispatch(n);
+  return c.accessed;
+}
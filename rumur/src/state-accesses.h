@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <rumur/rumur.h>
+#include <set>
+#include <string>
+
+/** Get the names of the state variables an AST node reads or writes.
+ *
+ * References through aliases are attributed to the variable aliased and the
+ * bodies of any called functions are included. This does not distinguish
+ * reads from writes, nor which part of a variable is accessed, so it is a
+ * conservative over-approximation.
+ */
+std::set<std::string> state_accesses(const rumur::Node &n);
@@ -6,6 +6,7 @@
 #include <rumur/rumur.h>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include "utils.h"
 
 using namespace rumur;
@@ -46,3 +47,31 @@ mpz_class bit_width(const mpz_class &v) {
   }
   return bits;
 }
+
+namespace { class OffsetUpdater : public Traversal {
+
+ public:
+  std::unordered_map<std::string, mpz_class> offsets;
+
+  void visit_exprid(ExprID &n) final {
+    if (auto v = dynamic_cast<VarDecl*>(n.value.get())) {
+      // only state variables have an offset
+      if (v->offset >= 0) {
+        auto it = offsets.find(v->name);
+        if (it != offsets.end())
+          v->offset = it->second;
+      }
+    }
+  }
+}; }
+
+void update_state_offsets(Model &m) {
+
+  OffsetUpdater u;
+  for (const Ptr<Decl> &d : m.decls) {
+    if (auto v = dynamic_cast<const VarDecl*>(d.get()))
+      u.offsets[v->name] = v->offset;
+  }
+
+  u.dispatch(m);
+}
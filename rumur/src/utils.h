@@ -18,3 +18,10 @@ std::string to_C_string(const rumur::location &location);
 
 // how many bits are required to store `v` unique values?
 mpz_class bit_width(const mpz_class &v);
+
+/* Update references to state variables throughout a model to reflect the
+ * current offsets of the model's variables. Expressions referring to a state
+ * variable hold their own copy of its declaration, so this is needed after
+ * anything that moves variables within the state.
+ */
+void update_state_offsets(rumur::Model &m);
@@ -0,0 +1,44 @@
+-- rumur_flags: ['--align-fields', 'on']
+
+-- basic test that byte-aligning state variables works
+
+type
+  r: record
+    a: 0 .. 2;
+    b: boolean;
+  end;
+
+var
+  x: boolean;
+  y: 0 .. 1000;
+  z: array[0 .. 2] of r;
+  w: 0 .. 5;
+
+startstate begin
+  x := true;
+  y := 0;
+  for i: 0 .. 2 do
+    z[i].a := 0;
+    z[i].b := false;
+  end;
+  w := 0;
+end;
+
+rule begin
+  x := !x;
+end;
+
+rule begin
+  y := 1000 - y;
+end;
+
+ruleset i: 0 .. 2 do
+  rule begin
+    z[i].a := (z[i].a + 1) % 3;
+    z[i].b := !z[i].b;
+  end;
+end;
+
+rule begin
+  w := (w + 1) % 6;
+end;
@@ -0,0 +1,49 @@
+'''
+Helpers for tests that generate, compile and run a checker themselves, rather
+than relying on the generic .m test case logic in run-tests.py. This is not
+executable, so run-tests.py does not treat it as a test case.
+'''
+
+import os
+import subprocess as sp
+import tempfile
+
+CC = os.environ.get('CC', 'cc')
+
+def build(model: str, flags: [str], tmp: str) -> str:
+  'generate and compile a checker in the given directory, returning its path'
+
+  model_c = os.path.join(tmp, 'model.c')
+  sp.run(['rumur', '--output', model_c] + flags,
+    input=model.encode('utf-8', 'replace'), check=True)
+
+  model_bin = os.path.join(tmp, 'model.exe')
+  sp.check_call([CC, '-std=c11', '-o', model_bin, model_c, '-lpthread'])
+
+  return model_bin
+
+def run(model: str, flags: [str], telemetry: bool = False) -> (int, str, str):
+  '''
+  build and run a checker, returning its exit status, its output and, if
+  requested, the telemetry it wrote
+  '''
+
+  fds = ()
+  if telemetry:
+    # the checker inherits the write end of this pipe at the same number
+    r, w = os.pipe()
+    fds = (w,)
+    flags = ['--telemetry', str(w)] + flags
+
+  with tempfile.TemporaryDirectory() as tmp:
+    model_bin = build(model, flags, tmp)
+
+    p = sp.Popen([model_bin], stdout=sp.PIPE, stderr=sp.STDOUT, pass_fds=fds)
+    records = None
+    if telemetry:
+      os.close(w)
+      with os.fdopen(r, 'rt', encoding='utf-8') as f:
+        records = f.read()
+    stdout, _ = p.communicate()
+
+  return p.returncode, stdout.decode('utf-8', 'replace'), records
@@ -0,0 +1,29 @@
+-- rumur_flags: ['--max-errors', '10', '--deduplicate-errors', 'on']
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'^\t2 error\(s\) found\.\n\n\t(4 occurrences of: invariant "x small" failed\n\t5 occurrences of: y full|5 occurrences of: y full\n\t4 occurrences of: invariant "x small" failed)\n', re.MULTILINE)
+
+-- Both errors below are reached from several states, but each should be
+-- reported with a trace only once.
+
+var
+  x: 0 .. 9;
+  y: 0 .. 3;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "x" x < 9 ==> begin
+  x := x + 1;
+end;
+
+rule "y" y < 3 ==> begin
+  y := y + 1;
+end;
+
+rule "bad" y = 3 ==> begin
+  error "y full";
+end;
+
+invariant "x small" x < 5;
@@ -0,0 +1,19 @@
+-- rumur_flags: ['--edge-log', 'on']
+-- checker_output: None if self.xml else re.compile(r'\b199 further liveness constraints proved\b')
+
+/* The same model as liveness-cycle.m, but with the final liveness check
+ * reading successors from the edge log instead of firing rules again.
+ */
+
+var
+  x: 0 .. 199;
+
+startstate begin
+  x := 0;
+end;
+
+rule begin
+  x := (x + 1) % 200;
+end;
+
+liveness "x returns to 0" x = 0;
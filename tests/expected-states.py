@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+
+'''
+Test that a checker built with --expected-states, given the state count of a
+previous run, allocates a seen set large enough that it never expands.
+'''
+
+import checker
+import json
+import re
+import sys
+
+MODEL = '''
+var
+  x: array[0 .. 2] of 0 .. 7;
+
+startstate begin
+  for i: 0 .. 2 do
+    x[i] := 0;
+  end;
+end;
+
+ruleset i: 0 .. 2 do
+  rule x[i] < 7 ==> begin
+    x[i] := x[i] + 1;
+  end;
+
+  rule x[i] > 0 ==> begin
+    x[i] := 0;
+  end;
+end;
+'''
+
+def check(flags: [str]) -> (int, dict):
+  'run a checker, returning its states and final telemetry record'
+
+  # use a tiny default set, so it must be expanded without --expected-states
+  returncode, output, telemetry = checker.run(MODEL,
+    ['--set-capacity', '1024'] + flags, telemetry=True)
+  assert returncode == 0, f'checker failed:\n{output}'
+
+  states = re.search(r'\b(\d+) states, \d+ rules fired\b', output)
+  assert states is not None, f'unexpected checker output: {output}'
+
+  final = json.loads(telemetry.splitlines()[-1])
+  assert final['final'], 'no final telemetry record'
+
+  return int(states.group(1)), final
+
+def main():
+
+  states, final = check([])
+  assert states == 512, f'unexpected state count {states}'
+  assert final['set_expansions'] > 0, f'set was never expanded: {final}'
+
+  # size the set from the previous run
+  states, final = check(['--expected-states', str(states)])
+  assert states == 512, f'unexpected state count {states}'
+  assert final['set_expansions'] == 0, f'set was expanded: {final}'
+  assert final['set_slots'] == 1024, f'unexpected set size: {final}'
+
+  # an underestimate should still find every state
+  states, final = check(['--expected-states', '100',
+    '--set-expand-threshold', '100'])
+  assert states == 512, f'unexpected state count {states}'
+  assert final['set_expansions'] > 0, f'set was never expanded: {final}'
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,24 @@
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'read of undefined value in x\[1\]\.b')
+
+-- Reads of state components at locations known when the verifier is generated
+-- take a different path to other reads. Check they still detect reading an
+-- undefined value.
+
+type
+  r: record
+    a: 0 .. 2;
+    b: boolean;
+  end;
+
+var
+  x: array[0 .. 2] of r;
+
+startstate begin
+  x[0].a := 0;
+  x[1].a := 1;
+end;
+
+rule x[1].b ==> begin
+  x[2].a := 2;
+end;
@@ -0,0 +1,49 @@
+-- rumur_flags: ['--fold-constants', 'on']
+-- checker_output: re.compile(r'\bstates="4"' if self.xml else r'\b4 states\b')
+
+-- A model with constant conditions, a small loop with constant bounds, a
+-- branch that is never taken and a rule that can never fire. Folding these
+-- must not change the behaviour of the model.
+
+const
+  N: 3;
+  DEBUG: false;
+
+var
+  x: array[0 .. N - 1] of 0 .. 3;
+  y: 0 .. 3;
+
+startstate begin
+  for i: 0 .. N - 1 do
+    x[i] := i * 0;
+  end;
+  if DEBUG then
+    error "unreachable branch";
+  elsif N > 2 then
+    y := 0;
+  else
+    error "unreachable branch";
+  end;
+end;
+
+rule y < N ==> begin
+  for i := N - 1 to 0 by -1 do
+    if i = y then
+      x[i] := (1 + 1) * 1;
+    end;
+  end;
+  y := y + 1;
+end;
+
+rule y = N ==> begin
+  for i: 0 .. N - 1 do
+    x[i] := 0;
+  end;
+  y := 0;
+end;
+
+rule DEBUG & y = 0 ==> begin
+  error "rule that can never fire";
+end;
+
+invariant x[N - 1] <= 2 * 1;
@@ -0,0 +1,39 @@
+-- rumur_flags: ['--guard-cache', 'on']
+-- checker_output: re.compile(r'\bstates="64"' if self.xml else r'\b64 states\b')
+
+-- Rules whose guards read state variables only some other rules write, so that
+-- successors inherit a mix of cached and invalidated guard results. Guards
+-- reaching state through aliases and functions must be invalidated too. If a
+-- stale cached result were used, the state count would differ.
+
+var
+  x: array[0 .. 1] of 0 .. 3;
+  y: 0 .. 3;
+
+function y_below(bound: 0 .. 4): boolean;
+begin
+  return y < bound;
+end;
+
+startstate begin
+  for i: 0 .. 1 do
+    x[i] := 0;
+  end;
+  y := 0;
+end;
+
+ruleset i: 0 .. 1 do
+  alias xi: x[i] do
+    rule xi < 3 ==> begin
+      xi := xi + 1;
+    end;
+  end;
+end;
+
+rule y_below(3) ==> begin
+  y := y + 1;
+end;
+
+rule x[0] = 3 & x[1] = 3 ==> begin
+  y := 0;
+end;
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+
+'''
+Test that --guard-cache actually avoids evaluating rule guards, by comparing
+the guard evaluations counted by --rule-statistics with and without it.
+'''
+
+import checker
+import os
+import re
+import sys
+
+# reuse the model whose state count guard-cache.m checks
+with open(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+    'guard-cache.m'), 'rt', encoding='utf-8') as f:
+  MODEL = f.read()
+
+def check(flags: [str]) -> (int, int):
+  'run a checker, returning states and guards evaluated'
+
+  returncode, output, _ = checker.run(MODEL,
+    ['--threads', '1', '--rule-statistics', 'on'] + flags)
+  assert returncode == 0, f'checker failed:\n{output}'
+
+  states = re.search(r'\b(\d+) states, \d+ rules fired\b', output)
+  assert states is not None, f'unexpected checker output:\n{output}'
+
+  # per-rule totals are indented once, their instances twice
+  guards = [int(g) for g in
+    re.findall(r'^\t[^\t].*\b(\d+) guards evaluated\b', output, re.MULTILINE)]
+  assert len(guards) == 3, f'unexpected rule statistics:\n{output}'
+
+  return int(states.group(1)), sum(guards)
+
+def main():
+
+  states, guards = check(['--guard-cache', 'off'])
+  cached_states, cached_guards = check(['--guard-cache', 'on'])
+
+  assert cached_states == states == 64, \
+    f'state count changed from {states} to {cached_states} with guard cache'
+  assert cached_guards < guards, \
+    f'guard cache did not avoid any of {guards} guard evaluations'
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
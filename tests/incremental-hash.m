@@ -0,0 +1,55 @@
+-- rumur_flags: ['--incremental-hash', 'on']
+
+-- Exercise the writes that must keep an incrementally maintained state hash up
+-- to date: simple assignments, complex (record and array) assignments,
+-- undefine, clear, function returns and scalarset permutation. In debug builds
+-- the checker asserts the incremental hash matches one computed from scratch.
+
+type
+  pid: scalarset(3);
+  r: record
+    a: 0 .. 3;
+    b: boolean;
+  end;
+
+var
+  x: array[pid] of r;
+  y: r;
+  z: 0 .. 3;
+
+function next(v: r): r;
+var w: r;
+begin
+  w := v;
+  w.a := (v.a + 1) % 4;
+  return w;
+end;
+
+startstate begin
+  for p: pid do
+    x[p].a := 0;
+    x[p].b := false;
+  end;
+  undefine y;
+  z := 0;
+end;
+
+ruleset p: pid do
+  rule begin
+    x[p] := next(x[p]);
+  end;
+
+  rule begin
+    y := x[p];
+    x[p].b := !x[p].b;
+  end;
+end;
+
+rule begin
+  undefine y;
+end;
+
+rule begin
+  clear y;
+  z := (z + 1) % 4;
+end;
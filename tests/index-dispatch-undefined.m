@@ -0,0 +1,20 @@
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'\bread of undefined value\b')
+
+-- A guard beginning with a comparison of an element indexed by the ruleset
+-- parameter should still report reading an undefined element, rather than the
+-- rule being skipped as if the comparison were false.
+
+var
+  x: array[0 .. 2] of boolean;
+
+startstate begin
+  x[0] := false;
+  x[1] := false;
+end;
+
+ruleset i: 0 .. 2 do
+  rule x[i] = true ==> begin
+    x[i] := false;
+  end;
+end;
@@ -0,0 +1,38 @@
+-- checker_output: re.compile(r'\bstates="4096"' if self.xml else r'\b4096 states\b')
+
+-- A ruleset over enough indices for the generated checker to evaluate the
+-- leading conjunct of its guards several elements at a time. Elements have an
+-- odd width, so they fall at every offset within a byte. If an enabled index
+-- were missed, fewer states would be found.
+
+type
+  node: 0 .. 11;
+
+var
+  x: array[node] of record
+    v: boolean;
+    w: 0 .. 2;
+    z: 0 .. 0;
+  end;
+  pad: array[0 .. 7] of 0 .. 255;
+
+startstate begin
+  for i: node do
+    x[i].v := false;
+    x[i].w := 0;
+    x[i].z := 0;
+  end;
+  for i: 0 .. 7 do
+    pad[i] := 0;
+  end;
+end;
+
+ruleset i: node do
+  rule x[i].v = false ==> begin
+    x[i].v := true;
+  end;
+
+  rule true = x[i].v ==> begin
+    x[i].v := false;
+  end;
+end;
@@ -0,0 +1,41 @@
+-- checker_output: re.compile(r'\bstates="81"' if self.xml else r'\b81 states\b')
+
+-- Rulesets whose guards begin by comparing an element indexed by the ruleset
+-- parameter against a constant. The generated checker only evaluates these
+-- guards for indices whose element matches. If it skipped a matching index,
+-- fewer states would be found.
+
+type
+  node: 0 .. 3;
+  status: enum { Idle, Busy, Done };
+
+var
+  q: array[node] of record
+    state: status;
+    count: 0 .. 1;
+  end;
+
+startstate begin
+  for i: node do
+    q[i].state := Idle;
+    q[i].count := 0;
+  end;
+end;
+
+ruleset i: node do
+  rule "start" q[i].state = Idle & q[i].count = 0 ==> begin
+    q[i].state := Busy;
+  end;
+
+  rule "finish" Busy = q[i].state ==> begin
+    q[i].state := Done;
+    q[i].count := 1;
+  end;
+end;
+
+ruleset i: 1 .. 2 do
+  rule "reset" q[i].state = Done ==> begin
+    q[i].state := Idle;
+    q[i].count := 0;
+  end;
+end;
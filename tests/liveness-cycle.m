@@ -0,0 +1,21 @@
+-- rumur_flags: ['--threads', '4']
+-- checker_output: None if self.xml else re.compile(r'\b199 further liveness constraints proved\b')
+
+/* A liveness property that, apart from the start state, is only satisfied by
+ * following the de-duplicated edge that closes a cycle. Proving it requires
+ * the final liveness check to pass the property all the way back around the
+ * cycle.
+ */
+
+var
+  x: 0 .. 199;
+
+startstate begin
+  x := 0;
+end;
+
+rule begin
+  x := (x + 1) % 200;
+end;
+
+liveness "x returns to 0" x = 0;
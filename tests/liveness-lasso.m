@@ -0,0 +1,28 @@
+-- checker_exit_code: 1
+-- checker_output: re.compile(r'<loop>\s*<transition>' if self.xml else r'cycle then repeats forever:\s*Rule 3 fired\.\s*x:[789]\s')
+
+/* A liveness property that is violated because the system can enter a cycle
+ * that never returns to the property's state. The counterexample should show
+ * this cycle.
+ */
+
+var
+  x: 0 .. 10;
+
+startstate begin
+  x := 0;
+end;
+
+rule x < 5 ==> begin
+  x := x + 1;
+end;
+
+rule x = 5 ==> begin
+  x := 7;
+end;
+
+rule x >= 7 ==> begin
+  x := x = 9 ? 7 : x + 1;
+end;
+
+liveness "x is 6" x = 6;
@@ -0,0 +1,33 @@
+-- rumur_flags: ['--max-errors', '200']
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'(The following is the error trace for the error:(?:(?!The following).)*?End of the error trace\.\s*){200}', re.DOTALL)
+
+/* A model with many errors, spread across many states. Each error report
+ * should be written out whole, even when several threads are finding errors
+ * at the same time.
+ */
+
+var
+  b: array[0 .. 3] of boolean;
+  x: 0 .. 63;
+
+startstate begin
+  for i: 0 .. 3 do
+    b[i] := false;
+  end;
+  x := 0;
+end;
+
+ruleset i: 0 .. 3 do
+  rule "flip" begin
+    b[i] := !b[i];
+  end;
+end;
+
+ruleset v: 1 .. 63 do
+  rule "bad" x = 0 ==> begin
+    x := v;
+  end;
+end;
+
+invariant "x is zero" x = 0;
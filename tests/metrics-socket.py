@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+
+'''
+Test that a checker built with --metrics-socket serves metrics in the Prometheus
+text format while it is running.
+'''
+
+import checker
+import os
+import re
+import socket
+import subprocess as sp
+import sys
+import tempfile
+import time
+
+# a model with a state space too large to finish exploring during the test
+MODEL = '''
+var
+  x: array[0 .. 3] of 0 .. 1000000;
+
+startstate begin
+  for i: 0 .. 3 do
+    x[i] := 0;
+  end;
+end;
+
+ruleset i: 0 .. 3 do
+  rule x[i] < 1000000 ==> begin
+    x[i] := x[i] + 1;
+  end;
+end;
+'''
+
+def scrape(path: str, request: bytes) -> str:
+  'connect to a metrics socket and return what it sends back'
+  with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+    s.settimeout(5)
+    s.connect(path)
+    if request:
+      s.sendall(request)
+    else:
+      s.shutdown(socket.SHUT_WR)
+    response = b''
+    while True:
+      data = s.recv(4096)
+      if not data:
+        break
+      response += data
+  return response.decode('utf-8', 'replace')
+
+def main():
+
+  with tempfile.TemporaryDirectory() as tmp:
+    model_bin = checker.build(MODEL,
+      ['--threads', '1', '--metrics-socket', 'metrics.sock'], tmp)
+
+    # the socket is created relative to the checker's working directory
+    path = os.path.join(tmp, 'metrics.sock')
+    p = sp.Popen([model_bin], stdout=sp.DEVNULL, cwd=tmp)
+    try:
+      for _ in range(100):
+        if os.path.exists(path):
+          break
+        time.sleep(0.1)
+      else:
+        raise AssertionError('metrics socket was not created')
+
+      # a plain client gets just the metrics
+      plain = scrape(path, b'')
+      states = re.search(r'^rumur_states (\d+)$', plain, re.MULTILINE)
+      assert states is not None, f'no state count in metrics:\n{plain}'
+      for metric in ('rumur_rules_fired_total{thread="0"}',
+                     'rumur_queue_size{thread="0"}', 'rumur_set_slots',
+                     'rumur_set_expansions_total', 'rumur_errors'):
+        assert re.search(rf'^{re.escape(metric)} \d+$', plain, re.MULTILINE), \
+          f'missing {metric} in metrics:\n{plain}'
+
+      # an HTTP client gets the metrics in an HTTP response
+      http = scrape(path, b'GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n')
+      header, _, body = http.partition('\r\n\r\n')
+      assert header.startswith('HTTP/1.0 200 OK'), \
+        f'unexpected HTTP response:\n{http}'
+      length = re.search(r'^Content-Length: (\d+)$', header, re.MULTILINE)
+      assert length is not None and int(length.group(1)) == len(body), \
+        f'incorrect Content-Length in HTTP response:\n{http}'
+
+      # the checker should be making progress
+      later = re.search(r'^rumur_states (\d+)$', body, re.MULTILINE)
+      assert later is not None and int(later.group(1)) >= int(states.group(1)), \
+        f'state count went backwards:\n{body}'
+
+      # a client that sends nothing and keeps its connection open should still
+      # get the metrics, and should not hold up other clients
+      with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as silent:
+        silent.settimeout(5)
+        silent.connect(path)
+        try:
+          other = scrape(path, b'GET /metrics HTTP/1.1\r\n\r\n')
+        except socket.timeout:
+          raise AssertionError('metrics socket blocked by a silent client')
+        assert other.startswith('HTTP/1.0 200 OK'), \
+          f'unexpected HTTP response:\n{other}'
+        try:
+          reply = silent.recv(4096).decode('utf-8', 'replace')
+        except socket.timeout:
+          raise AssertionError('silent client got no metrics')
+        assert reply.startswith('# HELP'), \
+          f'unexpected response to silent client:\n{reply}'
+
+    finally:
+      p.kill()
+      p.wait()
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
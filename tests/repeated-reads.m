@@ -0,0 +1,29 @@
+-- Guards and invariants that read the same values repeatedly, some of them
+-- undefined. Reusing a value read earlier in the expression must not read
+-- anything the expression would not otherwise have reached, so no error should
+-- be reported here.
+
+var
+  x: 0 .. 2;
+  y: 0 .. 2;
+  z: array[0 .. 1] of boolean;
+
+startstate begin
+  x := 0;
+  undefine y;
+  z[0] := false;
+  undefine z[1];
+end;
+
+ruleset i: 0 .. 1 do
+  rule x < 2 & (i = 0 | x = 1) & (isundefined(y) | y = y + 0) &
+       (i = 1 | z[i] = z[i]) ==> begin
+    x := x + 1;
+  end;
+end;
+
+rule x = 2 ==> begin
+  x := 0;
+end;
+
+invariant x = 0 | x = 1 | x = 2 | y = y;
@@ -0,0 +1,28 @@
+-- rumur_flags: ['--max-errors', '10', '--guard-cache', 'on']
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'\boops\b.*\bindex out of range\b.*\bdeadlock\b.*\b3 error\(s\) found\b', re.DOTALL)
+
+-- Errors in a rule or guard should not stop the checker trying the remaining
+-- rules of the same state, including detecting it is deadlocked.
+
+var
+  x: 0 .. 4;
+  a: array[0 .. 3] of boolean;
+
+startstate begin
+  x := 0;
+  for i: 0 .. 3 do
+    a[i] := false;
+  end;
+end;
+
+rule "fail" x = 1 ==> begin
+  error "oops";
+end;
+
+rule "peek" !a[x] ==> begin
+end;
+
+rule "step" x < 4 ==> begin
+  x := x + 1;
+end;
@@ -0,0 +1,30 @@
+-- rumur_flags: ['--rule-profile-generate', os.devnull]
+-- checker_output: re.compile(r'\bstates="64"' if self.xml else r'\b64 states\b')
+
+-- Collecting a rule profile should not change the behaviour of the checker,
+-- including when run multithreaded.
+
+var
+  x: array[0 .. 1] of 0 .. 3;
+  y: 0 .. 3;
+
+startstate begin
+  for i: 0 .. 1 do
+    x[i] := 0;
+  end;
+  y := 0;
+end;
+
+ruleset i: 0 .. 1 do
+  rule x[i] < 3 ==> begin
+    x[i] := x[i] + 1;
+  end;
+end;
+
+rule y < 3 ==> begin
+  y := y + 1;
+end;
+
+rule x[0] = 3 & x[1] = 3 ==> begin
+  y := 0;
+end;
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+
+'''
+Test that a checker built with --rule-profile-generate writes a profile that
+--rule-profile can read back, and that reordering rules according to it does not
+confuse the rule names printed in counterexample traces.
+'''
+
+import checker
+import os
+import re
+import sys
+import tempfile
+
+# a model whose rules have very different guard hit rates
+MODEL = '''
+var
+  x: 0 .. 4;
+  y: array[0 .. 2] of boolean;
+
+startstate begin
+  x := 0;
+  for i: 0 .. 2 do
+    y[i] := false;
+  end;
+end;
+
+rule "rare" x = 3 & y[2] ==> begin
+  x := 4;
+end;
+
+ruleset i: 0 .. 2 do
+  rule "set" !y[i] ==> begin
+    y[i] := true;
+  end;
+end;
+
+rule "step" x < 3 ==> begin
+  x := x + 1;
+end;
+
+invariant "x never reaches 4" x != 4;
+'''
+
+def check(flags: [str]) -> str:
+  'run a checker that is expected to find the invariant violation'
+  returncode, output, _ = checker.run(MODEL, ['--threads', '1'] + flags)
+  assert returncode == 1, 'checker did not find the invariant violation'
+  return output
+
+def main():
+
+  with tempfile.TemporaryDirectory() as tmp:
+    profile = os.path.join(tmp, 'profile')
+
+    # run an instrumented checker
+    check(['--rule-profile-generate', profile])
+
+    with open(profile, 'rt', encoding='utf-8') as f:
+      entries = [l.split(' ', 4) for l in f if not l.startswith('#')]
+    names = [e[4].strip() for e in entries]
+    assert names == ['"rare"', '"set"', '"step"'], \
+      f'unexpected rules in profile: {names}'
+    for e in entries:
+      evaluated, enabled, successors, fresh = (int(x) for x in e[:4])
+      assert enabled <= evaluated and fresh <= successors <= enabled, \
+        f'inconsistent profile entry: {e}'
+
+    # regenerate using the profile, which should try "step" first
+    output = check(['--rule-profile', profile])
+    trace = re.findall(r'^Rule (.*) fired\.$', output, re.MULTILINE)
+    assert trace[-1] == '"rare"', f'unexpected counterexample trace: {trace}'
+    assert set(trace) <= {'"step"', '"set", i: 2', '"rare"'}, \
+      f'unexpected rules in counterexample trace: {trace}'
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
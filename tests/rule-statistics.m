@@ -0,0 +1,39 @@
+-- rumur_flags: ['--rule-statistics', 'on']
+-- checker_output: re.compile(r'<instance evaluated="80" fired="20"' if self.xml else r'\bi: 1, k: green: 80 tried, 20 fired\b')
+
+-- Per-rule statistics should count each instance of a ruleset separately,
+-- including when run multithreaded.
+
+type
+  colour: enum { red, green };
+
+var
+  x: 0 .. 4;
+  y: array[0 .. 2] of boolean;
+  c: colour;
+
+startstate begin
+  x := 0;
+  for i: 0 .. 2 do
+    y[i] := false;
+  end;
+  c := red;
+end;
+
+ruleset i: 0 .. 2; k: colour do
+  rule "set" !y[i] & c = k ==> begin
+    y[i] := true;
+  end;
+end;
+
+rule "step" x < 4 ==> begin
+  x := x + 1;
+end;
+
+rule "reset" x = 4 ==> begin
+  x := 0;
+  for i: 0 .. 2 do
+    y[i] := false;
+  end;
+  c := green;
+end;
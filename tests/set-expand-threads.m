@@ -0,0 +1,28 @@
+-- rumur_flags: ['--threads', '8', '--set-capacity', '256', '--set-expand-threshold', '100']
+-- checker_output: None if self.xml else re.compile(r'\b46656 states\b')
+
+-- Expand a nearly full seen set many times with more threads than there is
+-- work for. Threads that have moved to an expanded set can fill it before the
+-- others have left the old one, and should wait for them rather than losing or
+-- duplicating states.
+
+var
+  x: array[0 .. 5] of 0 .. 5;
+
+startstate begin
+  for i: 0 .. 5 do
+    x[i] := 0;
+  end;
+end;
+
+ruleset i: 0 .. 5 do
+  rule "step" x[i] < 5 ==> begin
+    x[i] := x[i] + 1;
+  end;
+end;
+
+rule "reset" x[0] = 5 ==> begin
+  for i: 0 .. 5 do
+    x[i] := 0;
+  end;
+end;
@@ -0,0 +1,29 @@
+-- skip_reason: 'N/A in XML mode' if self.xml else 'N/A in non-debug mode' if hasattr(self, 'debug') and not self.debug else None
+-- checker_output: re.compile(r'\bfield z is located at state offset 0 bits$', re.MULTILINE)
+
+-- Field reordering should place state variables that are read by guards at the
+-- front of the state, ahead of fields it would otherwise prefer based on their
+-- width.
+
+var
+  -- these are a power of two width and would be placed first if not for...
+  x: boolean;
+  y: boolean;
+
+  -- ...this field, that is read by a guard
+  z: 0 .. 5;
+
+startstate begin
+  x := true;
+  y := false;
+  z := 0;
+end;
+
+rule z < 5 ==> begin
+  z := z + 1;
+end;
+
+rule begin
+  x := !x;
+  y := !y;
+end;
@@ -0,0 +1,24 @@
+-- rumur_flags: ['--telemetry', '2', '--telemetry-interval', '1']
+-- checker_output: re.compile(r'\bstates="512"' if self.xml else r'\b512 states\b')
+
+-- Writing telemetry (here to stderr) should not change the behaviour of the
+-- checker, including when run multithreaded.
+
+var
+  x: array[0 .. 2] of 0 .. 7;
+
+startstate begin
+  for i: 0 .. 2 do
+    x[i] := 0;
+  end;
+end;
+
+ruleset i: 0 .. 2 do
+  rule x[i] < 7 ==> begin
+    x[i] := x[i] + 1;
+  end;
+
+  rule x[i] > 0 ==> begin
+    x[i] := 0;
+  end;
+end;
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+
+'''
+Test that a checker built with --telemetry writes well-formed records to the
+given file descriptor, ending with a final record that agrees with the checker's
+summary.
+'''
+
+import checker
+import json
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+MODEL = '''
+var
+  x: array[0 .. 2] of 0 .. 7;
+
+startstate begin
+  for i: 0 .. 2 do
+    x[i] := 0;
+  end;
+end;
+
+ruleset i: 0 .. 2 do
+  rule x[i] < 7 ==> begin
+    x[i] := x[i] + 1;
+  end;
+
+  rule x[i] > 0 ==> begin
+    x[i] := 0;
+  end;
+end;
+'''
+
+def check(flags: [str]) -> (str, str):
+  'run a checker, returning its output and telemetry'
+  returncode, output, telemetry = checker.run(MODEL,
+    ['--threads', '1', '--telemetry-interval', '1'] + flags, telemetry=True)
+  assert returncode == 0, f'checker failed:\n{output}'
+  return output, telemetry
+
+def main():
+
+  output, telemetry = check([])
+  records = [json.loads(l) for l in telemetry.splitlines()]
+  assert len(records) > 0, 'no telemetry written'
+  assert all(not r['final'] for r in records[:-1]), \
+    'final record written before the end of checking'
+  final = records[-1]
+  assert final['final'], 'no final telemetry record'
+  assert final['states'] == 512, f'unexpected final record: {final}'
+  assert len(final['threads']) == 1, \
+    f'unexpected threads in final record: {final}'
+  fired = re.search(r'\b512 states, (\d+) rules fired\b', output)
+  assert fired is not None, f'unexpected checker output: {output}'
+  assert final['rules_fired'] == int(fired.group(1)), \
+    f'final record disagrees with summary: {final}'
+  times = [r['time'] for r in records]
+  assert times == sorted(times), f'time went backwards: {times}'
+
+  _, telemetry = check(['--output-format', 'machine-readable'])
+  records = [ET.fromstring(l) for l in telemetry.splitlines()]
+  final = records[-1]
+  assert final.tag == 'telemetry' and final.get('final') == 'true' \
+    and final.get('states') == '512', \
+    f'unexpected final record: {ET.tostring(final)}'
+  assert len(final.findall('thread')) == 1, \
+    f'unexpected threads in final record: {ET.tostring(final)}'
+
+  return 0
+
+if __name__ == '__main__':
+  sys.exit(main())
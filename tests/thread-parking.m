@@ -0,0 +1,28 @@
+-- rumur_flags: ['--threads', '4', '--set-capacity', '1024', '--deadlock-detection', 'off']
+-- checker_output: None if self.xml else re.compile(r'\b4295 states\b')
+
+-- A state space that is wide enough to start every thread and then narrows to
+-- a long chain. Threads that run out of work while the chain is explored should
+-- wait for more, and still help when the seen set is expanded, rather than
+-- exiting early or blocking those with work to do.
+
+var
+  x: array[0 .. 3] of 0 .. 7;
+  y: 0 .. 199;
+
+startstate begin
+  for i: 0 .. 3 do
+    x[i] := 0;
+  end;
+  y := 0;
+end;
+
+ruleset i: 0 .. 3 do
+  rule "widen" x[i] < 7 ==> begin
+    x[i] := x[i] + 1;
+  end;
+end;
+
+rule "narrow" forall i: 0 .. 3 do x[i] = 7 end & y < 199 ==> begin
+  y := y + 1;
+end;
@@ -0,0 +1,22 @@
+-- rumur_flags: ['--threads', '4', '--thread-startup', 'eager', '--deadlock-detection', 'off']
+-- checker_output: None if self.xml else re.compile(r'\b104 states\b')
+
+-- A state space that is a long chain. Most threads have nothing to do for most
+-- of the run, but should wait for work rather than exiting early.
+
+var
+  x: 0 .. 100;
+  y: 0 .. 3;
+
+startstate begin
+  x := 0;
+  y := 0;
+end;
+
+rule "forward" x < 100 ==> begin
+  x := x + 1;
+end;
+
+rule "last" x = 100 & y < 3 ==> begin
+  y := y + 1;
+end;
@@ -0,0 +1,28 @@
+-- rumur_flags: ['--trace-replay', 'on']
+-- checker_exit_code: 1
+-- checker_output: None if self.xml else re.compile(r'Startstate 1 fired\.\s*x:0\s*-+\s*Rule "inc" fired\.\s*x:1\s*-+\s*Rule "inc" fired\.\s*x:2\s*-+\s*Rule "inc" fired\.\s*x:3\s*-+\s*End of the error trace')
+
+/* Test that a counterexample trace can be reconstructed without predecessor
+ * pointers. The trace should be the shortest one, and not go through "detour".
+ */
+
+var
+  x: 0 .. 10;
+
+startstate begin
+  x := 0;
+end;
+
+rule "detour" x = 0 ==> begin
+  x := 8;
+end;
+
+rule "back" x = 9 ==> begin
+  x := 2;
+end;
+
+rule "inc" x < 10 ==> begin
+  x := x + 1;
+end;
+
+invariant "x is not 3" x != 3;